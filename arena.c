@@ -0,0 +1,83 @@
+#include <string.h>
+#include <errno.h>
+
+#include "arena.h"
+
+/* every block is preceded by its size, rounded up to the alignment */
+typedef union mib_arena_hdr {
+	size_t size;
+	unsigned char pad[ MIB_ARENA_ALIGN ];
+} mib_arena_hdr_t;
+
+void mib_arena_init( mib_arena_t *a, void *base, size_t size )
+{
+	memset( a, 0, sizeof(mib_arena_t) );
+	a->base = (unsigned char *)base;
+	a->size = size;
+	a->last = (size_t)-1;
+}
+
+static inline size_t mib_arena_round( size_t n )
+{
+	return (n + MIB_ARENA_ALIGN - 1) & ~(size_t)(MIB_ARENA_ALIGN - 1);
+}
+
+void *mib_arena_realloc( void *arg, void *ptr, size_t size )
+{
+	mib_arena_t *a = (mib_arena_t *)arg;
+	mib_arena_hdr_t *hdr = NULL;
+	size_t at, need;
+	void *p;
+
+	if ( ptr ) {
+		hdr = (mib_arena_hdr_t *)ptr - 1;
+		at = (unsigned char *)hdr - a->base;
+
+		if ( at == a->last ) {
+			/* newest block: free, shrink or grow in place */
+			if ( !size ) {
+				a->used = at;
+				a->last = (size_t)-1;
+				return NULL;
+			}
+			need = at + sizeof(*hdr) + mib_arena_round( size );
+			if ( need > a->size ) {
+				errno = ENOMEM;
+				return NULL;
+			}
+			hdr->size = size;
+			a->used = need;
+			if ( a->used > a->peak )
+				a->peak = a->used;
+			return ptr;
+		}
+
+		/* older blocks stay where they are until the arena is reset */
+		if ( !size )
+			return NULL;
+		if ( size <= hdr->size )
+			return ptr;
+	}
+
+	if ( !size )
+		return NULL;
+
+	need = a->used + sizeof(mib_arena_hdr_t) + mib_arena_round( size );
+	if ( need > a->size ) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	hdr = (mib_arena_hdr_t *)(a->base + a->used);
+	hdr->size = size;
+	a->last = a->used;
+	a->used = need;
+	if ( a->used > a->peak )
+		a->peak = a->used;
+
+	p = hdr + 1;
+	if ( ptr )
+		memcpy( p, ptr, ((mib_arena_hdr_t *)ptr - 1)->size );
+
+	return p;
+}
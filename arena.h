@@ -0,0 +1,88 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Fixed size bump allocator behind the mib_realloc_t hook. Only the
+ * most recent block can grow in place or be given back, which is all
+ * the load path needs: the flash window grows while the section is
+ * read, then the decode buffer is taken once.
+ *
+ * Building with -DMIB_STATIC_ARENA makes rtkmib take every buffer of
+ * a query from one static arena of MIB_ARENA_SIZE bytes. Include
+ * rtkmib.h, mibtbl.h, lzss.h, flash.h and mib.h first for the sizes.
+ */
+typedef struct mib_arena {
+	unsigned char *base;
+	size_t size;
+	size_t used;
+	size_t last;		/* offset of the newest block */
+	size_t peak;
+} mib_arena_t;
+
+void mib_arena_init( mib_arena_t *a, void *base, size_t size );
+
+/* mib_realloc_t, arg is the arena; fails with ENOMEM when full */
+void *mib_arena_realloc( void *arg, void *ptr, size_t size );
+
+#define MIB_ARENA_ALIGN		16
+#define MIB_ARENA_BLOCK(n)						\
+	((((n) + MIB_ARENA_ALIGN - 1) & ~(size_t)(MIB_ARENA_ALIGN - 1)) +\
+	 MIB_ARENA_ALIGN)
+
+/* largest read alignment (flash page or MTD write size) supported */
+#define MIB_ARENA_PAGE		4096
+
+/* room for vendor TLVs that are not in MIBTBL_FIELDS */
+#ifndef MIB_ARENA_SLACK
+#define MIB_ARENA_SLACK		1024
+#endif
+
+/*
+ * Largest decoded section accepted: header, every known field once per
+ * interface with its TLV header, a table header per interface, the end
+ * marker, the checksum byte and the slack above.
+ */
+#define MIB_ARENA_SECTION						\
+	(sizeof(mib_hdr_t) + sizeof(mib_t) +				\
+	 4 * (MIB_FIELDS_NUM * NUM_WLAN_INTERFACE +			\
+	      NUM_WLAN_INTERFACE + 1) + 1 + MIB_ARENA_SLACK)
+
+/* the flash window: read-ahead or the compressed section, aligned */
+#define MIB_ARENA_PAYLOAD						\
+	(sizeof(mib_hdr_compr_t) + LZSS_BOUND(MIB_ARENA_SECTION))
+#define MIB_ARENA_WINDOW						\
+	((MIB_ARENA_PAYLOAD > FLASH_READAHEAD ?				\
+	  MIB_ARENA_PAYLOAD : FLASH_READAHEAD) + 2 * MIB_ARENA_PAGE)
+
+/* bounds for the context and stream state, checked in mib.c */
+#define MIB_ARENA_CTX		(sizeof(mib_t) + 256)
+#define MIB_ARENA_STREAM	(RING_SIZE + 512)
+
+/*
+ * Peak use: the context plus either the flash window and the decode
+ * buffer (full load, and more for -c below), the stream decoder
+ * state (-g and -q queries) or the -s test decode buffer. -w
+ * re-encodes and merges whole erase blocks, rtkmib gives it libc
+ * instead, as it does for the -s image if it can not be mapped.
+ */
+#define MIB_ARENA_LOAD							\
+	(MIB_ARENA_BLOCK(MIB_ARENA_WINDOW) +				\
+	 MIB_ARENA_BLOCK(MIB_ARENA_SECTION))
+/* -c: the reference decoder's ring and output, with its stray byte */
+#define MIB_ARENA_COMPARE						\
+	(MIB_ARENA_LOAD + MIB_ARENA_BLOCK(RING_SIZE + UL_MATCH - 1) +	\
+	 MIB_ARENA_BLOCK(MIB_ARENA_SECTION + 1))
+/* -s: one section at a time is test decoded */
+#define MIB_ARENA_SCAN		MIB_ARENA_BLOCK(MIB_ARENA_SECTION)
+
+#define MIB_ARENA_MAX(a, b)	((a) > (b) ? (a) : (b))
+#define MIB_ARENA_SIZE							\
+	(MIB_ARENA_BLOCK(MIB_ARENA_CTX) +				\
+	 MIB_ARENA_MAX(MIB_ARENA_COMPARE,				\
+		       MIB_ARENA_MAX(2 * MIB_ARENA_BLOCK(MIB_ARENA_STREAM), \
+				     MIB_ARENA_SCAN)))
+
+#endif /* _ARENA_H_ */
@@ -0,0 +1,141 @@
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "rtkmib.h"
+#include "cache.h"
+
+uint64_t mib_fingerprint( uint64_t h, const unsigned char *p, uint32_t len )
+{
+	while ( len-- ) {
+		h ^= *p++;
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+int mib_cache_path( char *path, size_t size, const char *infile,
+		    unsigned int offset )
+{
+	const char *dir = MIB_CACHE_DIR;
+	uint64_t key;
+	int n;
+
+	if ( access( dir, W_OK ) )
+		dir = MIB_CACHE_DIR_FALLBACK;
+
+	key = mib_fingerprint( MIB_FP_INIT, (const unsigned char *)infile,
+			       strlen(infile) );
+	n = snprintf( path, size, "%s/rtkmib-%016llx-%x.cache", dir,
+		      (unsigned long long)key, offset );
+
+	return n < 0 || (size_t)n >= size ? -1 : 0;
+}
+
+static int read_all( int fd, void *buf, size_t len )
+{
+	unsigned char *p = (unsigned char *)buf;
+	ssize_t n;
+
+	while ( len ) {
+		n = read( fd, p, len );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return -1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int write_all( int fd, const void *buf, size_t len )
+{
+	const unsigned char *p = (const unsigned char *)buf;
+	ssize_t n;
+
+	while ( len ) {
+		n = write( fd, p, len );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return -1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int mib_cache_load( const char *path, uint64_t fingerprint, mib_t *mib )
+{
+	mib_cache_hdr_t hdr;
+	struct stat st;
+	int fd, len = -1;
+
+	fd = open( path, O_RDONLY | O_NOFOLLOW );
+	if ( fd < 0 )
+		return -1;
+
+	/* /tmp is shared, only trust files nobody else could have written */
+	if ( fstat( fd, &st ) || !S_ISREG(st.st_mode) ||
+	     st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+	     st.st_size != sizeof(hdr) + sizeof(mib_t) )
+		goto out;
+
+	if ( read_all( fd, &hdr, sizeof(hdr) ) ||
+	     memcmp( hdr.magic, MIB_CACHE_MAGIC, sizeof(hdr.magic) ) ||
+	     hdr.layout != sizeof(mib_t) ||
+	     hdr.wlan_size != sizeof(mib_wlan_t) ||
+	     hdr.fingerprint != fingerprint || hdr.len < 0 )
+		goto out;
+
+	if ( read_all( fd, mib, sizeof(mib_t) ) )
+		goto out;
+
+	len = hdr.len;
+out:
+	close( fd );
+	return len;
+}
+
+int mib_cache_store( const char *path, uint64_t fingerprint,
+		     const mib_t *mib, int len )
+{
+	mib_cache_hdr_t hdr;
+	char tmp[ PATH_MAX ];
+	int fd, n;
+
+	n = snprintf( tmp, sizeof(tmp), "%s.XXXXXX", path );
+	if ( n < 0 || (size_t)n >= sizeof(tmp) )
+		return -1;
+
+	fd = mkstemp( tmp );
+	if ( fd < 0 )
+		return -1;
+
+	memset( &hdr, 0, sizeof(hdr) );
+	memcpy( hdr.magic, MIB_CACHE_MAGIC, sizeof(hdr.magic) );
+	hdr.layout = sizeof(mib_t);
+	hdr.wlan_size = sizeof(mib_wlan_t);
+	hdr.len = len;
+	hdr.fingerprint = fingerprint;
+
+	if ( write_all( fd, &hdr, sizeof(hdr) ) ||
+	     write_all( fd, mib, sizeof(mib_t) ) ||
+	     fchmod( fd, 0644 ) ) {
+		close( fd );
+		unlink( tmp );
+		return -1;
+	}
+	close( fd );
+
+	/* readers see either the old file or the complete new one */
+	if ( rename( tmp, path ) ) {
+		unlink( tmp );
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Decoded MIB cache. A parsed mib_t is kept in a small file on tmpfs
+ * together with a fingerprint of the on-flash section it came from, so
+ * later runs only have to read and hash the raw section.
+ */
+#define MIB_CACHE_DIR		"/run"
+#define MIB_CACHE_DIR_FALLBACK	"/tmp"
+
+#define MIB_CACHE_MAGIC		"RMC1"
+
+typedef struct mib_cache_hdr {
+	char magic[4];
+	uint32_t layout;	/* sizeof(mib_t) */
+	uint32_t wlan_size;	/* sizeof(mib_wlan_t) */
+	int32_t len;		/* section length returned by mib_load() */
+	uint64_t fingerprint;
+} mib_cache_hdr_t;
+
+/* FNV-1a, 64 bit */
+#define MIB_FP_INIT		0xcbf29ce484222325ULL
+
+uint64_t mib_fingerprint( uint64_t h, const unsigned char *p, uint32_t len );
+
+/* cache file name for a given input and section offset */
+int mib_cache_path( char *path, size_t size, const char *infile,
+		    unsigned int offset );
+
+/*
+ * Fill *mib from the cache if it was written for the same section and
+ * the same mib_t layout. Returns the cached length or -1.
+ */
+int mib_cache_load( const char *path, uint64_t fingerprint, mib_t *mib );
+
+/* replace the cache file atomically, returns 0 on success */
+int mib_cache_store( const char *path, uint64_t fingerprint,
+		     const mib_t *mib, int len );
+
+#endif /* _CACHE_H_ */
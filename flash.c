@@ -0,0 +1,335 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <mtd/mtd-user.h>
+#include <linux/fs.h>
+
+#include "flash.h"
+
+static inline int is_pow2( uint32_t x )
+{
+	return x && !(x & (x - 1));
+}
+
+/* through the hook from flash_set_alloc(), size 0 frees */
+static void *flash_realloc( flash_t *fl, void *ptr, size_t size )
+{
+	if ( fl->alloc )
+		return fl->alloc( fl->alloc_arg, ptr, size );
+	if ( !size ) {
+		free( ptr );
+		return NULL;
+	}
+	return realloc( ptr, size );
+}
+
+static ssize_t flash_fd_read( flash_t *fl, void *buf, size_t len,
+			      off_t offset )
+{
+	return pread( fl->fd, buf, len, offset );
+}
+
+static ssize_t flash_fd_program( flash_t *fl, const void *buf, size_t len,
+				 off_t offset )
+{
+	return pwrite( fl->fd, buf, len, offset );
+}
+
+#ifdef MEMERASE
+static int flash_fd_erase( flash_t *fl, off_t offset, uint32_t len )
+{
+	struct erase_info_user ei = { offset, len };
+
+	return ioctl( fl->fd, MEMERASE, &ei );
+}
+#endif
+
+static const flash_ops_t flash_fd_ops = {
+	.read = flash_fd_read,
+	.program = flash_fd_program,
+#ifdef MEMERASE
+	.erase = flash_fd_erase,
+#endif
+};
+
+static int flash_open_flags( flash_t *fl, const char *path, int flags )
+{
+	struct stat st;
+	long page = sysconf( _SC_PAGESIZE );
+
+	memset( fl, 0, sizeof(flash_t) );
+	fl->align = page > 0 ? page : 4096;
+	fl->ops = &flash_fd_ops;
+
+	fl->fd = open( path, flags );
+	if ( fl->fd < 0 )
+		return -1;
+
+	if ( fstat( fl->fd, &st ) )
+		return 0;
+	fl->size = st.st_size;
+
+	/* image files: map them and skip the copy, devices keep pread() */
+	if ( S_ISREG(st.st_mode) && st.st_size > 0 &&
+	     (uint64_t)st.st_size <= SIZE_MAX ) {
+		void *p = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED,
+				fl->fd, 0 );
+		if ( p != MAP_FAILED ) {
+			fl->map = (unsigned char *)p;
+			fl->map_size = st.st_size;
+			return 0;
+		}
+	}
+
+#ifdef MEMGETINFO
+	/* raw mtd character devices know their geometry */
+	if ( S_ISCHR(st.st_mode) ) {
+		struct mtd_info_user info;
+
+		if ( !ioctl( fl->fd, MEMGETINFO, &info ) ) {
+			fl->size = info.size;
+			fl->erasesize = info.erasesize;
+			if ( is_pow2( info.writesize ) &&
+			     info.writesize > fl->align )
+				fl->align = info.writesize;
+		}
+	}
+#endif
+
+#ifdef BLKGETSIZE64
+	if ( S_ISBLK(st.st_mode) ) {
+		uint64_t size;
+
+		if ( !ioctl( fl->fd, BLKGETSIZE64, &size ) )
+			fl->size = size;
+	}
+#endif
+
+	return 0;
+}
+
+int flash_open( flash_t *fl, const char *path )
+{
+	return flash_open_flags( fl, path, O_RDONLY );
+}
+
+int flash_open_rw( flash_t *fl, const char *path )
+{
+	return flash_open_flags( fl, path, O_RDWR );
+}
+
+void flash_close( flash_t *fl )
+{
+	if ( fl->fd >= 0 )
+		close( fl->fd );
+	if ( fl->map )
+		munmap( fl->map, fl->map_size );
+	if ( fl->buf )
+		flash_realloc( fl, fl->buf, 0 );
+	memset( fl, 0, sizeof(flash_t) );
+	fl->fd = -1;
+}
+
+void flash_set_ops( flash_t *fl, const flash_ops_t *ops, void *priv )
+{
+	fl->ops = ops;
+	fl->priv = priv;
+	if ( fl->map ) {
+		munmap( fl->map, fl->map_size );
+		fl->map = NULL;
+		fl->map_size = 0;
+	}
+}
+
+void flash_set_alloc( flash_t *fl,
+		      void *(*alloc)( void *arg, void *ptr, size_t size ),
+		      void *arg )
+{
+	fl->alloc = alloc;
+	fl->alloc_arg = arg;
+}
+
+/* read [start, start + len) into buf + at, accepting a short read at EOF */
+static int flash_fill( flash_t *fl, uint32_t at, off_t start, uint32_t len )
+{
+	ssize_t n;
+
+	while ( len ) {
+		n = fl->ops->read( fl, fl->buf + at, len, start );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n < 0 )
+			return -1;
+		if ( n == 0 )
+			break;
+		at += n;
+		start += n;
+		len -= n;
+	}
+
+	fl->len = at;
+	return 0;
+}
+
+static int flash_reserve( flash_t *fl, uint32_t size )
+{
+	unsigned char *p;
+
+	if ( size <= fl->buf_size )
+		return 0;
+
+	p = (unsigned char *)flash_realloc( fl, fl->buf, size );
+	if ( !p )
+		return -1;
+
+	fl->buf = p;
+	fl->buf_size = size;
+	return 0;
+}
+
+unsigned char *flash_map( flash_t *fl, off_t offset, uint32_t len )
+{
+	off_t start, end, need;
+
+	if ( fl->fd < 0 || offset < 0 ) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	need = offset + len;
+
+	if ( fl->map ) {
+		if ( (uint64_t)need > fl->map_size ) {
+			errno = EIO;
+			return NULL;
+		}
+		return fl->map + offset;
+	}
+
+	/* already covered */
+	if ( offset >= fl->start && need <= fl->start + fl->len )
+		return fl->buf + (offset - fl->start);
+
+	if ( fl->len && offset >= fl->start &&
+	     offset <= fl->start + fl->len ) {
+		/* extend the current window with the missing tail only */
+		end = (need + fl->align - 1) & ~((off_t)fl->align - 1);
+		if ( flash_reserve( fl, end - fl->start ) )
+			return NULL;
+		if ( flash_fill( fl, fl->len, fl->start + fl->len,
+				 end - fl->start - fl->len ) )
+			return NULL;
+	} else {
+		/* new window: aligned, with some speculative read-ahead */
+		start = offset & ~((off_t)fl->align - 1);
+		end = offset + (len > FLASH_READAHEAD ? len : FLASH_READAHEAD);
+		end = (end + fl->align - 1) & ~((off_t)fl->align - 1);
+
+		/* do not spill speculatively into the next erase block */
+		if ( fl->erasesize ) {
+			off_t block = offset - offset % fl->erasesize +
+							fl->erasesize;
+			if ( need <= block && end > block )
+				end = block;
+		}
+
+		fl->start = start;
+		fl->len = 0;
+		if ( flash_reserve( fl, end - start ) )
+			return NULL;
+		if ( flash_fill( fl, 0, start, end - start ) )
+			return NULL;
+	}
+
+	if ( need > fl->start + fl->len ) {
+		errno = EIO;
+		return NULL;
+	}
+
+	return fl->buf + (offset - fl->start);
+}
+
+static int flash_write_all( flash_t *fl, const unsigned char *buf,
+			    uint32_t len, off_t start )
+{
+	ssize_t n;
+
+	while ( len ) {
+		n = fl->ops->program( fl, buf, len, start );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return -1;
+		buf += n;
+		start += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int flash_update( flash_t *fl, off_t offset, const unsigned char *buf,
+		  uint32_t len, unsigned int *blocks )
+{
+	uint32_t bs = fl->erasesize ? fl->erasesize : FLASH_ERASESIZE_DEFAULT;
+	off_t block, end = offset + len;
+	uint32_t size, at, n;
+	unsigned char *cur, *blk;
+	int written = 0;
+
+	if ( blocks )
+		*blocks = 0;
+	if ( fl->fd < 0 || offset < 0 ) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ( fl->size && end > fl->size ) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	blk = (unsigned char *)flash_realloc( fl, NULL, bs );
+	if ( !blk )
+		return -1;
+
+	for ( block = offset - offset % bs; block < end; block += bs ) {
+		size = bs;
+		if ( fl->size && block + size > fl->size )
+			size = fl->size - block;
+
+		cur = flash_map( fl, block, size );
+		if ( !cur )
+			goto fail;
+		memcpy( blk, cur, size );
+
+		at = block < offset ? offset - block : 0;
+		n = (end < block + size ? end : block + size) - (block + at);
+		memcpy( blk + at, buf + (block + at - offset), n );
+		if ( blocks )
+			(*blocks)++;
+		if ( !memcmp( blk, cur, size ) )
+			continue;
+
+		if ( fl->erasesize && fl->ops->erase &&
+		     fl->ops->erase( fl, block, size ) )
+			goto fail;
+		/* the window may hold the old contents */
+		fl->len = 0;
+		if ( flash_write_all( fl, blk, size, block ) )
+			goto fail;
+		written++;
+	}
+
+	flash_realloc( fl, blk, 0 );
+	return written;
+
+fail:
+	flash_realloc( fl, blk, 0 );
+	fl->len = 0;
+	return -1;
+}
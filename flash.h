@@ -0,0 +1,90 @@
+#ifndef _FLASH_H_
+#define _FLASH_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* how much to read past the header in the first go */
+#define FLASH_READAHEAD		0x2000
+
+/* write granularity for files and block devices, which do not say */
+#define FLASH_ERASESIZE_DEFAULT	0x10000
+
+struct flash;
+
+/*
+ * Device access below the window. The default backend works on fd with
+ * pread()/pwrite() and MEMERASE, a simulator can take its place with
+ * flash_set_ops(). read and program behave like pread() and pwrite(),
+ * erase is only called with whole erase blocks.
+ */
+typedef struct flash_ops {
+	ssize_t (*read)( struct flash *fl, void *buf, size_t len,
+			 off_t offset );
+	ssize_t (*program)( struct flash *fl, const void *buf, size_t len,
+			    off_t offset );
+	int (*erase)( struct flash *fl, off_t offset, uint32_t len );
+} flash_ops_t;
+
+/*
+ * A flash device (or image file) opened once and read through a single
+ * aligned window. flash_map() hands out pointers into that window and
+ * only goes back to the device when a range is not already covered.
+ * Regular files are memory mapped instead and flash_map() returns
+ * pointers straight into the mapping.
+ */
+typedef struct flash {
+	int fd;
+	unsigned char *map;	/* whole file mapping, NULL for devices */
+	size_t map_size;
+	off_t size;		/* device or file size, 0 if unknown */
+	uint32_t align;		/* read alignment: write or page size */
+	uint32_t erasesize;	/* erase block size, 0 if unknown */
+	unsigned char *buf;	/* window contents */
+	uint32_t buf_size;	/* allocated size of buf */
+	off_t start;		/* device offset of buf[0] */
+	uint32_t len;		/* valid bytes in buf */
+	void *(*alloc)( void *arg, void *ptr, size_t size );
+	void *alloc_arg;
+	const flash_ops_t *ops;
+	void *priv;		/* backend state */
+} flash_t;
+
+int flash_open( flash_t *fl, const char *path );
+/* the same, but open for flash_update() as well */
+int flash_open_rw( flash_t *fl, const char *path );
+void flash_close( flash_t *fl );
+
+/*
+ * Allocate the window and the erase block buffer of flash_update()
+ * through a realloc() style hook, size 0 frees. Call right after
+ * flash_open(), NULL goes back to libc.
+ */
+void flash_set_alloc( flash_t *fl,
+		      void *(*alloc)( void *arg, void *ptr, size_t size ),
+		      void *arg );
+
+/*
+ * Send device access through ops instead, priv is left in fl->priv.
+ * Call right after flash_open(); the file mapping is dropped so every
+ * read goes through the backend.
+ */
+void flash_set_ops( flash_t *fl, const flash_ops_t *ops, void *priv );
+
+/*
+ * Make [offset, offset + len) available and return a pointer to it,
+ * or NULL with errno set if the device can not supply the range.
+ */
+unsigned char *flash_map( flash_t *fl, off_t offset, uint32_t len );
+
+/*
+ * Store len bytes at offset. Every erase block the range touches is
+ * compared with what is on flash and only those that differ are
+ * erased (MTD devices) and programmed again. Returns the number of
+ * blocks written, *blocks is set to the number compared; -1 with errno
+ * set on failure. Pointers from flash_map() are stale afterwards.
+ */
+int flash_update( flash_t *fl, off_t offset, const unsigned char *buf,
+		  uint32_t len, unsigned int *blocks );
+
+#endif /* _FLASH_H_ */
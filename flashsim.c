@@ -0,0 +1,166 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "flash.h"
+#include "flashsim.h"
+
+static inline int is_pow2( uint32_t x )
+{
+	return x && !(x & (x - 1));
+}
+
+static void flash_sim_busy( flash_sim_t *sim, uint32_t us )
+{
+	struct timespec ts;
+
+	if ( !us )
+		return;
+
+	sim->busy_us += us;
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000L;
+	while ( nanosleep( &ts, &ts ) && errno == EINTR )
+		;
+}
+
+static ssize_t flash_sim_read( flash_t *fl, void *buf, size_t len,
+			       off_t offset )
+{
+	flash_sim_t *sim = (flash_sim_t *)fl->priv;
+	ssize_t n = pread( fl->fd, buf, len, offset );
+
+	if ( n > 0 ) {
+		sim->reads++;
+		sim->read_bytes += n;
+		flash_sim_busy( sim, sim->read_us );
+	}
+	return n;
+}
+
+/* one page at most, refused if it would need a bit to go back to 1 */
+static ssize_t flash_sim_program( flash_t *fl, const void *buf, size_t len,
+				  off_t offset )
+{
+	flash_sim_t *sim = (flash_sim_t *)fl->priv;
+	const unsigned char *p = (const unsigned char *)buf;
+	unsigned char old[ FLASH_SIM_PAGESIZE_MAX ];
+	size_t room = sim->pagesize - offset % sim->pagesize;
+	ssize_t n;
+	size_t i;
+
+	if ( len > room )
+		len = room;
+
+	n = pread( fl->fd, old, len, offset );
+	if ( n == (ssize_t)len ) {
+		for ( i = 0; i < len; i++ )
+			if ( p[i] & ~old[i] )
+				break;
+		if ( i < len ) {
+			errno = EIO;
+			n = -1;
+		} else {
+			n = pwrite( fl->fd, buf, len, offset );
+		}
+	} else if ( n >= 0 ) {
+		/* past the end of the image */
+		errno = ENOSPC;
+		n = -1;
+	}
+
+	if ( n > 0 ) {
+		sim->programs++;
+		flash_sim_busy( sim, sim->program_us );
+	}
+	return n;
+}
+
+static int flash_sim_erase( flash_t *fl, off_t offset, uint32_t len )
+{
+	flash_sim_t *sim = (flash_sim_t *)fl->priv;
+	unsigned char ff[ FLASH_SIM_PAGESIZE_MAX ];
+	uint32_t at, page;
+
+	if ( offset % sim->erasesize || len % sim->erasesize ) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* a block is a whole number of pages, blank it one page at a time */
+	memset( ff, 0xff, sim->pagesize );
+	for ( at = 0; at < len; at += sim->erasesize ) {
+		for ( page = 0; page < sim->erasesize; page += sim->pagesize )
+			if ( pwrite( fl->fd, ff, sim->pagesize,
+				     offset + at + page ) !=
+			     (ssize_t)sim->pagesize )
+				return -1;
+		sim->erases++;
+		flash_sim_busy( sim, sim->erase_us );
+	}
+
+	return 0;
+}
+
+static const flash_ops_t flash_sim_ops = {
+	.read = flash_sim_read,
+	.program = flash_sim_program,
+	.erase = flash_sim_erase,
+};
+
+int flash_sim_parse( flash_sim_t *sim, const char *spec )
+{
+	static const struct {
+		const char *key;
+		size_t off;
+		int size;
+	} keys[] = {
+		{ "erase", offsetof(flash_sim_t, erasesize), 1 },
+		{ "page", offsetof(flash_sim_t, pagesize), 1 },
+		{ "tread", offsetof(flash_sim_t, read_us), 0 },
+		{ "tprog", offsetof(flash_sim_t, program_us), 0 },
+		{ "terase", offsetof(flash_sim_t, erase_us), 0 },
+	};
+	const char *p = spec, *eq;
+	unsigned long v;
+	char *end;
+	size_t i, n;
+
+	memset( sim, 0, sizeof(flash_sim_t) );
+	sim->erasesize = FLASH_SIM_ERASESIZE;
+	sim->pagesize = FLASH_SIM_PAGESIZE;
+
+	while ( *p ) {
+		eq = strchr( p, '=' );
+		if ( !eq )
+			return -1;
+		n = eq - p;
+		for ( i = 0; i < sizeof(keys) / sizeof(keys[0]); i++ )
+			if ( strlen( keys[i].key ) == n &&
+			     !strncmp( p, keys[i].key, n ) )
+				break;
+		if ( i == sizeof(keys) / sizeof(keys[0]) )
+			return -1;
+
+		v = strtoul( eq + 1, &end, 0 );
+		if ( end == eq + 1 || (*end && *end != ',') ||
+		     v > UINT32_MAX || (keys[i].size && !is_pow2( v )) )
+			return -1;
+		*(uint32_t *)((char *)sim + keys[i].off) = v;
+
+		p = *end ? end + 1 : end;
+	}
+
+	return sim->pagesize <= sim->erasesize &&
+	       sim->pagesize <= FLASH_SIM_PAGESIZE_MAX ? 0 : -1;
+}
+
+void flash_sim_attach( flash_t *fl, flash_sim_t *sim )
+{
+	flash_set_ops( fl, &flash_sim_ops, sim );
+	fl->erasesize = sim->erasesize;
+	fl->align = sim->pagesize;
+}
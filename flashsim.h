@@ -0,0 +1,43 @@
+#ifndef _FLASHSIM_H_
+#define _FLASHSIM_H_
+
+#include <stdint.h>
+
+/*
+ * NOR flash simulator on top of an image file, for trying the read and
+ * write paths without hardware. The file keeps the contents; erases
+ * work on whole blocks and set them to 0xff, programs go page by page
+ * and may only clear bits, as on the real part. Every operation can
+ * be given a latency and is counted. Include flash.h first.
+ */
+#define FLASH_SIM_ERASESIZE	0x10000
+#define FLASH_SIM_PAGESIZE	0x100
+#define FLASH_SIM_PAGESIZE_MAX	0x1000	/* a page goes on the stack */
+
+typedef struct flash_sim {
+	uint32_t erasesize;	/* erase block, power of two */
+	uint32_t pagesize;	/* program page and read alignment */
+	uint32_t read_us;	/* per read request */
+	uint32_t program_us;	/* per page */
+	uint32_t erase_us;	/* per block */
+
+	uint64_t reads;
+	uint64_t read_bytes;
+	uint64_t programs;	/* pages */
+	uint64_t erases;	/* blocks */
+	uint64_t busy_us;	/* latency spent in the above */
+} flash_sim_t;
+
+/*
+ * Geometry and timing from a comma separated list of erase=, page=,
+ * tread=, tprog= and terase= (sizes in bytes, times in microseconds);
+ * anything not given keeps the defaults above and no latency.
+ * Returns 0 or -1 on an unknown key or an invalid size, pages above
+ * FLASH_SIM_PAGESIZE_MAX included.
+ */
+int flash_sim_parse( flash_sim_t *sim, const char *spec );
+
+/* put sim behind fl, right after flash_open() or flash_open_rw() */
+void flash_sim_attach( flash_t *fl, flash_sim_t *sim );
+
+#endif /* _FLASHSIM_H_ */
@@ -0,0 +1,563 @@
+#include "rtkmib.h"
+#include "lzss.h"
+
+/* the caller's allocator or libc; frees on size 0, ignores NULL there */
+static void *lzss_realloc( lzss_realloc_t alloc, void *arg, void *ptr,
+			   size_t size )
+{
+	if ( !size && !ptr )
+		return NULL;
+	if ( alloc )
+		return alloc( arg, ptr, size );
+	if ( !size ) {
+		free( ptr );
+		return NULL;
+	}
+	return realloc( ptr, size );
+}
+
+/*
+ * The encoder keeps a RING_SIZE history that starts out filled with
+ * spaces and writes the first output byte at RING_SIZE - UL_MATCH.
+ * Instead of maintaining that ring we use the output decoded so far as
+ * the history: a match at ring position i is simply a back reference
+ * of ((r - i) mod RING_SIZE) bytes, where r is the ring position of
+ * the next output byte. A distance of 0 wraps to a full RING_SIZE.
+ */
+int lzss_decode( const unsigned char *in, uint32_t len,
+		 unsigned char *out, uint32_t cap )
+{
+	if ( !in || !out )
+		return -1;
+
+	const unsigned char *end = in + len;
+	unsigned char *op = out;
+	unsigned char *oend = out + cap;
+	unsigned int flags = 0;
+	unsigned int i, n, dist, pos;
+
+	while ( op < oend ) {
+		if ( ((flags >>= 1) & 0x100) == 0 ) {
+			if ( in >= end )
+				break;
+			flags = *in++ | 0xff00;	/* count eight in the high byte */
+		}
+
+		if ( flags & 1 ) {
+			/* literal */
+			if ( in >= end )
+				break;
+			*op++ = *in++;
+			continue;
+		}
+
+		/* back reference */
+		if ( end - in < 2 )
+			break;
+		i = in[0] | ((in[1] & 0xf0) << 4);
+		n = (in[1] & 0x0f) + THRESHOLD + 1;
+		in += 2;
+
+		pos = op - out;
+		dist = (RING_SIZE - UL_MATCH + pos - i) & (RING_SIZE - 1);
+		if ( !dist )
+			dist = RING_SIZE;
+		if ( n > (unsigned int)(oend - op) )
+			n = oend - op;
+
+		if ( dist > pos ) {
+			/* reaches back before the first byte: initial spaces */
+			unsigned int pad = dist - pos;
+			if ( pad > n )
+				pad = n;
+			memset( op, ' ', pad );
+			op += pad;
+			n -= pad;
+		}
+
+		if ( dist >= n ) {
+			memcpy( op, op - dist, n );
+			op += n;
+		} else {
+			/* overlapping run, has to go byte by byte */
+			while ( n-- ) {
+				*op = *(op - dist);
+				op++;
+			}
+		}
+	}
+
+	return op - out;
+}
+
+int lzss_analyze( const unsigned char *in, uint32_t len, uint32_t cap,
+		  lzss_analysis_t *an )
+{
+	if ( !in || !an )
+		return -1;
+
+	const unsigned char *start = in;
+	const unsigned char *end = in + len;
+	unsigned int flags = 0;
+	unsigned int i, n, dist, b;
+	uint32_t pos = 0;
+
+	memset( an, 0, sizeof(lzss_analysis_t) );
+
+	while ( pos < cap ) {
+		if ( ((flags >>= 1) & 0x100) == 0 ) {
+			if ( in >= end )
+				break;
+			flags = *in++ | 0xff00;
+		}
+
+		if ( flags & 1 ) {
+			if ( in >= end )
+				break;
+			in++;
+			pos++;
+			an->literals++;
+			continue;
+		}
+
+		if ( end - in < 2 )
+			break;
+		i = in[0] | ((in[1] & 0xf0) << 4);
+		n = (in[1] & 0x0f) + THRESHOLD + 1;
+		in += 2;
+
+		dist = (RING_SIZE - UL_MATCH + pos - i) & (RING_SIZE - 1);
+		if ( !dist )
+			dist = RING_SIZE;
+		an->matches++;
+		an->len_hist[ n ]++;
+		for ( b = 0; dist >> (b + 1); b++ )
+			;
+		an->dist_hist[ b ]++;
+
+		if ( n > cap - pos )
+			n = cap - pos;
+		if ( dist > pos )
+			an->pad_bytes += dist - pos < n ? dist - pos : n;
+		an->match_bytes += n;
+		pos += n;
+	}
+
+	an->in = in - start;
+	an->out = pos;
+
+	return pos;
+}
+
+int mib_decode_into( unsigned char *in, uint32_t len,
+		     unsigned char **out, uint32_t *cap,
+		     lzss_realloc_t alloc, void *arg )
+{
+	if ( !in || !out || !cap || len < 1 )
+		return -1;
+
+	mib_hdr_t header;
+	uint32_t need;
+
+	/* peek at the decoded header to learn the final size */
+	if ( lzss_decode( in, len, (unsigned char *)&header,
+			  sizeof(mib_hdr_t) ) != sizeof(mib_hdr_t) )
+		return -1;
+
+	need = sizeof(mib_hdr_t) + swap16(header.len);
+
+	if ( need > *cap || !*out ) {
+		unsigned char *p = (unsigned char *)lzss_realloc( alloc, arg,
+								  *out, need );
+		if ( !p )
+			return -1;
+		*out = p;
+		*cap = need;
+	}
+
+	return lzss_decode( in, len, *out, need );
+}
+
+int mib_decode( unsigned char *in, uint32_t len, unsigned char **out,
+		lzss_realloc_t alloc, void *arg )
+{
+	uint32_t cap = 0;
+	int explen;
+
+	if ( !out )
+		return -1;
+
+	*out = NULL;
+	explen = mib_decode_into( in, len, out, &cap, alloc, arg );
+	if ( explen < 0 ) {
+		lzss_realloc( alloc, arg, *out, 0 );
+		*out = NULL;
+	}
+
+	return explen;
+}
+
+void lzss_stream_init( lzss_stream_t *s )
+{
+	s->flags = 0;
+	s->code = -1;
+	s->pos = 0;
+	s->flushed = 0;
+	/* history before the first byte reads as spaces */
+	memset( s->ring, ' ', RING_SIZE );
+}
+
+static int lzss_stream_flush( lzss_stream_t *s, lzss_sink_t sink, void *arg )
+{
+	uint32_t from = s->flushed & (RING_SIZE - 1);
+	uint32_t n = s->pos - s->flushed;
+
+	if ( !n )
+		return 0;
+
+	s->flushed = s->pos;
+	if ( from + n > RING_SIZE ) {
+		if ( sink( arg, s->ring + from, RING_SIZE - from ) )
+			return 1;
+		n -= RING_SIZE - from;
+		from = 0;
+	}
+
+	return sink( arg, s->ring + from, n );
+}
+
+int lzss_stream_decode( lzss_stream_t *s, const unsigned char *in,
+			uint32_t len, lzss_sink_t sink, void *arg )
+{
+	const unsigned char *end = in + len;
+	unsigned int i, n, dist;
+
+	for ( ;; ) {
+		/* unflushed output must never be overwritten in the ring */
+		if ( s->pos - s->flushed >= LZSS_FLUSH &&
+		     lzss_stream_flush( s, sink, arg ) )
+			return 1;
+
+		if ( !(s->flags & 0x100) ) {
+			if ( in >= end )
+				break;
+			s->flags = *in++ | 0xff00;
+		}
+
+		if ( s->flags & 1 ) {
+			if ( in >= end )
+				break;
+			s->ring[ s->pos++ & (RING_SIZE - 1) ] = *in++;
+		} else {
+			/* a back reference may be split between two calls */
+			if ( s->code < 0 ) {
+				if ( in >= end )
+					break;
+				s->code = *in++;
+			}
+			if ( in >= end )
+				break;
+			i = s->code | ((*in & 0xf0) << 4);
+			n = (*in & 0x0f) + THRESHOLD + 1;
+			in++;
+			s->code = -1;
+
+			dist = (RING_SIZE - UL_MATCH + s->pos - i) &
+							(RING_SIZE - 1);
+			if ( !dist )
+				dist = RING_SIZE;
+			while ( n-- ) {
+				s->ring[ s->pos & (RING_SIZE - 1) ] =
+					s->ring[ (s->pos - dist) &
+							(RING_SIZE - 1) ];
+				s->pos++;
+			}
+		}
+		s->flags >>= 1;
+	}
+
+	return lzss_stream_flush( s, sink, arg );
+}
+
+int mib_decode_ref( unsigned char *in, uint32_t len, unsigned char **out,
+		    lzss_realloc_t alloc, void *arg )
+{
+	if ( !in || !out || len < 1 )
+		return -1;
+
+	int  i, j, k, c;
+	int r = RING_SIZE - UL_MATCH;
+	unsigned int flags = 0;
+	unsigned int pos = 0;
+	unsigned int explen = 0;
+
+	unsigned char *text_buf, *p;
+
+	text_buf = (unsigned char *)lzss_realloc( alloc, arg, NULL,
+						  RING_SIZE + UL_MATCH - 1 );
+	if ( !text_buf )
+		return -1;
+
+	*out = (unsigned char *)lzss_realloc( alloc, arg, NULL, len );
+	if ( !*out ) {
+		lzss_realloc( alloc, arg, text_buf, 0 );
+		return -1;
+	}
+
+	/* original code initializes text_buf with spaces */
+	memset( text_buf, ' ', r );
+	memset( *out, 0, len );
+
+	while (1) {
+		if ( ((flags >>= 1) & 0x100) == 0 ) {
+			if ( pos++ > len )
+				break;
+			c = *in++;		/* get flags for frame */
+			flags = c | 0xff00;	/* uses higher byte cleverly */
+		}				/* to count eight */
+		/* test next flag bit */
+		if ( flags & 1 ) {
+			/* flag bit of 1 means unencoded byte */
+			if ( pos++ > len )
+				break;
+			c = *in++;
+			if ( explen + 1 > len ) {
+				p = (unsigned char *)lzss_realloc( alloc, arg,
+						*out, explen + 1 );
+				if ( !p )
+					goto fail;
+				*out = p;
+			}
+			(*out)[ explen ] = c;	/* copy to output */
+			//printf("%i: %x\n", explen, c); fflush(stdout);
+			explen++;
+			text_buf[ r ] = c;	/* and to text_buf */
+			r++;
+			r &= (RING_SIZE - 1);
+		} else {
+			/* 0 means encoded info */
+			if ( pos++ > len )
+				break;
+			i = *in++;		/* get position */
+			if ( pos++ > len )
+				break;
+			j = *in++;		/* get length of run */
+
+			i |= ((j & 0xf0) << 4);	    /* i is now offset of run */
+			j = (j & 0x0f) + THRESHOLD; /* j is the length */
+
+			for ( k = 0; k <= j; k++ ) {
+				c = text_buf[ (i + k) & (RING_SIZE - 1) ];
+				if ( explen + 1 > len ) {
+					p = (unsigned char *)lzss_realloc(
+						alloc, arg, *out, explen + 1 );
+					if ( !p )
+						goto fail;
+					*out = p;
+				}
+				(*out)[ explen ] = c;
+				//printf("c%i: %x\n", explen, c); fflush(stdout);
+				explen++;
+				text_buf[ r ] = c;
+				r++;
+				r &= (RING_SIZE - 1);
+			}
+		}
+	}
+
+	lzss_realloc( alloc, arg, text_buf, 0 );
+	return explen;
+
+fail:
+	lzss_realloc( alloc, arg, *out, 0 );
+	*out = NULL;
+	lzss_realloc( alloc, arg, text_buf, 0 );
+	return -1;
+}
+
+/*
+ * Hash chain match finder. Positions are chained through prev[], which
+ * is indexed modulo RING_SIZE: an entry is only overwritten once its
+ * position has dropped out of the window, so every chain we follow
+ * within LZSS_MAX_DIST is intact.
+ */
+#define LZSS_HASH_BITS	12
+#define LZSS_HASH_SIZE	(1 << LZSS_HASH_BITS)
+#define LZSS_MAX_CHAIN	256
+/* the decoder ring also holds the look-ahead, keep clear of it */
+#define LZSS_MAX_DIST	(RING_SIZE - UL_MATCH)
+
+typedef struct lzss_enc {
+	const unsigned char *in;
+	uint32_t len;
+	int32_t head[ LZSS_HASH_SIZE ];
+	int32_t prev[ RING_SIZE ];
+} lzss_enc_t;
+
+static inline unsigned int lzss_hash( const unsigned char *p )
+{
+	return ((p[0] << 8) ^ (p[1] << 4) ^ p[2]) & (LZSS_HASH_SIZE - 1);
+}
+
+static inline void lzss_insert( lzss_enc_t *s, uint32_t pos )
+{
+	if ( pos + THRESHOLD >= s->len )
+		return;
+
+	unsigned int h = lzss_hash( s->in + pos );
+	s->prev[ pos & (RING_SIZE - 1) ] = s->head[ h ];
+	s->head[ h ] = pos;
+}
+
+static unsigned int lzss_find( lzss_enc_t *s, uint32_t pos, uint32_t *match )
+{
+	const unsigned char *cur = s->in + pos;
+	unsigned int max = s->len - pos;
+	unsigned int best = 0;
+	int chain = LZSS_MAX_CHAIN;
+	int32_t cand;
+
+	if ( max <= THRESHOLD )
+		return 0;
+	if ( max > UL_MATCH )
+		max = UL_MATCH;
+
+	cand = s->head[ lzss_hash( cur ) ];
+	while ( cand >= 0 && pos - cand <= LZSS_MAX_DIST && chain-- ) {
+		const unsigned char *p = s->in + cand;
+		unsigned int l;
+
+		if ( p[ best ] == cur[ best ] ) {
+			for ( l = 0; l < max && p[l] == cur[l]; l++ )
+				;
+			if ( l > best ) {
+				best = l;
+				*match = cand;
+				if ( best == max )
+					break;
+			}
+		}
+		cand = s->prev[ cand & (RING_SIZE - 1) ];
+	}
+
+	return best;
+}
+
+int lzss_encode( const unsigned char *in, uint32_t len,
+		 unsigned char *out, uint32_t cap,
+		 lzss_realloc_t alloc, void *arg )
+{
+	if ( !in || !out )
+		return -1;
+
+	lzss_enc_t *s = (lzss_enc_t *)lzss_realloc( alloc, arg, NULL,
+						    sizeof(lzss_enc_t) );
+	if ( !s )
+		return -1;
+
+	unsigned char *op = out;
+	unsigned char *oend = out + cap;
+	unsigned char *flagp = NULL;
+	unsigned int bit = 0x100;
+	uint32_t pos = 0;
+	uint32_t mpos = 0, npos;
+	unsigned int mlen, i;
+
+	s->in = in;
+	s->len = len;
+	memset( s->head, 0xff, sizeof(s->head) );
+
+	while ( pos < len ) {
+		if ( bit == 0x100 ) {
+			/* start a new group of eight */
+			if ( op >= oend )
+				goto overflow;
+			flagp = op++;
+			*flagp = 0;
+			bit = 1;
+		}
+
+		mlen = lzss_find( s, pos, &mpos );
+		lzss_insert( s, pos );
+
+		/* lazy evaluation: a longer match one byte later wins */
+		if ( mlen > THRESHOLD && mlen < UL_MATCH &&
+		     lzss_find( s, pos + 1, &npos ) > mlen )
+			mlen = 0;
+
+		if ( mlen <= THRESHOLD ) {
+			if ( op >= oend )
+				goto overflow;
+			*flagp |= bit;
+			*op++ = in[ pos++ ];
+		} else {
+			unsigned int r = (RING_SIZE - UL_MATCH + mpos) &
+							(RING_SIZE - 1);
+			if ( oend - op < 2 )
+				goto overflow;
+			*op++ = r & 0xff;
+			*op++ = ((r >> 4) & 0xf0) | (mlen - (THRESHOLD + 1));
+			for ( i = 1; i < mlen; i++ )
+				lzss_insert( s, pos + i );
+			pos += mlen;
+		}
+		bit <<= 1;
+	}
+
+	lzss_realloc( alloc, arg, s, 0 );
+	return op - out;
+
+overflow:
+	lzss_realloc( alloc, arg, s, 0 );
+	return -1;
+}
+
+int mib_encode( const unsigned char *in, uint32_t len,
+		const char *type, unsigned char **out,
+		lzss_realloc_t alloc, void *arg )
+{
+	if ( !in || !type || !out || len < 1 )
+		return -1;
+
+	mib_hdr_compr_t *header;
+	unsigned char *check;
+	uint32_t cap = sizeof(mib_hdr_compr_t) + LZSS_BOUND(len);
+	int clen;
+
+	*out = (unsigned char *)lzss_realloc( alloc, arg, NULL, cap );
+	if ( !*out )
+		return -1;
+
+	clen = lzss_encode( in, len, *out + sizeof(mib_hdr_compr_t),
+			    cap - sizeof(mib_hdr_compr_t), alloc, arg );
+	if ( clen < 1 )
+		goto fail;
+
+	header = (mib_hdr_compr_t *)*out;
+	memcpy( header->sig, MIB_HEADER_COMP_TAG, MIB_COMPR_TAG_LEN );
+	memcpy( header->sig + MIB_COMPR_TAG_LEN, type,
+		MIB_COMPR_SIG_LEN - MIB_COMPR_TAG_LEN );
+	/* same rule as the vendor tools: decoders allocate factor * len */
+	header->factor = swap16( len / clen + 1 );
+	header->len = swap32( clen );
+
+	/* round trip through the decoder before handing it out */
+	check = (unsigned char *)lzss_realloc( alloc, arg, NULL, len );
+	if ( !check )
+		goto fail;
+	if ( lzss_decode( *out + sizeof(mib_hdr_compr_t), clen,
+			  check, len ) != (int)len ||
+	     memcmp( check, in, len ) )
+	{
+		lzss_realloc( alloc, arg, check, 0 );
+		goto fail;
+	}
+	lzss_realloc( alloc, arg, check, 0 );
+
+	return sizeof(mib_hdr_compr_t) + clen;
+
+fail:
+	lzss_realloc( alloc, arg, *out, 0 );
+	*out = NULL;
+	return -1;
+}
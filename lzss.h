@@ -0,0 +1,120 @@
+#ifndef _LZSS_H_
+#define _LZSS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RING_SIZE       4096    /* size of ring buffer, must be power of 2 */
+#define UL_MATCH        18      /* upper limit for match_length */
+#define THRESHOLD       2       /* encode string into position and length
+                                 * if match_length is greater than this */
+
+/*
+ * realloc() style allocator, the same as mib_realloc_t: size 0 frees
+ * ptr, NULL ptr allocates. Wherever one is taken NULL selects libc.
+ */
+typedef void *(*lzss_realloc_t)( void *arg, void *ptr, size_t size );
+
+/*
+ * Decode a COMP payload into a caller supplied buffer of cap bytes.
+ * Returns the number of bytes written, decoding stops at whichever of
+ * the input or the output runs out first.
+ */
+int lzss_decode( const unsigned char *in, uint32_t len,
+		 unsigned char *out, uint32_t cap );
+
+/*
+ * Decode a COMP payload into a buffer from alloc sized from the
+ * mib_hdr_t found at the start of the decoded stream.
+ */
+int mib_decode( unsigned char *in, uint32_t len, unsigned char **out,
+		lzss_realloc_t alloc, void *arg );
+
+/*
+ * Same as mib_decode() but reuses *out, holding *cap bytes, and only
+ * grows it through alloc when the section does not fit.
+ */
+int mib_decode_into( unsigned char *in, uint32_t len,
+		     unsigned char **out, uint32_t *cap,
+		     lzss_realloc_t alloc, void *arg );
+
+/*
+ * What a COMP payload is made of. Back reference distances go into
+ * dist_hist by bit length: bucket b counts distances in [2^b, 2^(b+1)).
+ * pad_bytes are match bytes taken from the spaces before the start.
+ */
+#define LZSS_DIST_BUCKETS	13
+
+typedef struct lzss_analysis {
+	uint32_t in;		/* payload bytes consumed */
+	uint32_t out;		/* bytes produced */
+	uint32_t literals;
+	uint32_t matches;
+	uint32_t match_bytes;
+	uint32_t pad_bytes;
+	uint32_t len_hist[ UL_MATCH + 1 ];
+	uint32_t dist_hist[ LZSS_DIST_BUCKETS ];
+} lzss_analysis_t;
+
+/*
+ * Walk a COMP payload the way lzss_decode() does, producing at most
+ * cap bytes, and count instead of copying. Returns the output size.
+ */
+int lzss_analyze( const unsigned char *in, uint32_t len, uint32_t cap,
+		  lzss_analysis_t *an );
+
+/* worst case size of lzss_encode() output: one flag byte per 8 literals */
+#define LZSS_BOUND(len)	((len) + ((len) + 7) / 8)
+
+/*
+ * Encode len bytes into out, which must hold at least cap bytes. The
+ * match finder state comes from alloc. Returns the encoded size or -1
+ * if cap is too small.
+ */
+int lzss_encode( const unsigned char *in, uint32_t len,
+		 unsigned char *out, uint32_t cap,
+		 lzss_realloc_t alloc, void *arg );
+
+/*
+ * Compress a decoded section (mib_hdr_t + data) into a COMP image
+ * allocated from alloc: mib_hdr_compr_t followed by the payload.
+ * type is the two character section tag, e.g. MIB_HEADER_COMPHS_TAG.
+ * The result is decoded again and compared before it is returned.
+ */
+int mib_encode( const unsigned char *in, uint32_t len,
+		const char *type, unsigned char **out,
+		lzss_realloc_t alloc, void *arg );
+
+/*
+ * Incremental decoder for input that arrives in pieces. Output goes
+ * through a RING_SIZE history and is handed to the sink in chunks of
+ * up to LZSS_FLUSH bytes; a non-zero return from the sink stops the
+ * decoder.
+ */
+#define LZSS_FLUSH	2048
+
+typedef int (*lzss_sink_t)( void *arg, const unsigned char *buf,
+			    uint32_t len );
+
+typedef struct lzss_stream {
+	unsigned int flags;	/* flag bits left in the current group */
+	int code;		/* first byte of a split back reference */
+	uint32_t pos;		/* bytes decoded so far */
+	uint32_t flushed;	/* bytes passed to the sink so far */
+	unsigned char ring[ RING_SIZE ];
+} lzss_stream_t;
+
+void lzss_stream_init( lzss_stream_t *s );
+
+/*
+ * Decode len more bytes of input. Returns 1 if the sink asked to stop,
+ * 0 once all input is consumed and its output flushed.
+ */
+int lzss_stream_decode( lzss_stream_t *s, const unsigned char *in,
+			uint32_t len, lzss_sink_t sink, void *arg );
+
+/* original byte-at-a-time decoder, kept as a reference; *out from alloc */
+int mib_decode_ref( unsigned char *in, uint32_t len, unsigned char **out,
+		    lzss_realloc_t alloc, void *arg );
+
+#endif /* _LZSS_H_ */
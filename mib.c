@@ -0,0 +1,1956 @@
+#include <stdarg.h>
+
+#include "rtkmib.h"
+#include "mibtbl.h"
+#include "lzss.h"
+#include "flash.h"
+#include "cache.h"
+#include "mib.h"
+#include "scan.h"
+#include "arena.h"
+#include "mibhash.h"
+
+struct mib_ctx {
+	mib_realloc_t alloc;
+	void *alloc_arg;
+	mib_log_t log;
+	void *log_arg;
+	int log_level;
+	unsigned char *dec;	/* decoded section, reused between loads */
+	uint32_t dec_cap;
+	int dec_fixed;		/* dec belongs to the caller */
+	mib_t mib;		/* compressed tables are parsed into this */
+	mib_stats_t stats;
+};
+
+/* the static arena is sized from these bounds */
+typedef char mib_ctx_fits_arena[
+		sizeof(struct mib_ctx) <= MIB_ARENA_CTX ? 1 : -1 ];
+typedef char mib_lzss_fits_arena[
+		sizeof(lzss_stream_t) <= MIB_ARENA_STREAM ? 1 : -1 ];
+
+static void *mib_libc_realloc( void *arg, void *ptr, size_t size )
+{
+	if ( !size ) {
+		free( ptr );
+		return NULL;
+	}
+
+	return realloc( ptr, size );
+}
+
+mib_ctx_t *mib_ctx_new( mib_realloc_t alloc, void *alloc_arg,
+			mib_log_t log, void *log_arg )
+{
+	mib_ctx_t *ctx;
+
+	if ( !alloc )
+		alloc = mib_libc_realloc;
+
+	ctx = (mib_ctx_t *)alloc( alloc_arg, NULL, sizeof(mib_ctx_t) );
+	if ( !ctx )
+		return NULL;
+
+	memset( ctx, 0, sizeof(mib_ctx_t) );
+	ctx->alloc = alloc;
+	ctx->alloc_arg = alloc_arg;
+	ctx->log = log;
+	ctx->log_arg = log_arg;
+	ctx->log_level = MIB_LOG_ERR;
+
+	return ctx;
+}
+
+void mib_ctx_free( mib_ctx_t *ctx )
+{
+	if ( !ctx )
+		return;
+
+	if ( !ctx->dec_fixed )
+		mib_free( ctx, ctx->dec );
+	ctx->alloc( ctx->alloc_arg, ctx, 0 );
+}
+
+void mib_ctx_set_log_level( mib_ctx_t *ctx, int level )
+{
+	ctx->log_level = level;
+}
+
+void mib_ctx_set_buffer( mib_ctx_t *ctx, unsigned char *buf, uint32_t cap )
+{
+	if ( !ctx->dec_fixed )
+		mib_free( ctx, ctx->dec );
+	ctx->dec = buf;
+	ctx->dec_cap = cap;
+	ctx->dec_fixed = 1;
+}
+
+const char *const mib_stage_names[ MIB_STAGES ] = {
+	"open", "header", "read", "decode", "parse", "cache", "format",
+	"write"
+};
+
+const mib_stats_t *mib_ctx_stats( mib_ctx_t *ctx )
+{
+	return &ctx->stats;
+}
+
+/* charge the time since *t to stage and restart the clock */
+static inline void mib_stage( mib_ctx_t *ctx, int stage, uint64_t *t,
+			      uint64_t bytes )
+{
+	uint64_t now = mib_now_ns();
+
+	ctx->stats.ns[ stage ] += now - *t;
+	ctx->stats.bytes[ stage ] += bytes;
+	*t = now;
+}
+
+void *mib_alloc( mib_ctx_t *ctx, size_t size )
+{
+	return ctx->alloc( ctx->alloc_arg, NULL, size );
+}
+
+void mib_free( mib_ctx_t *ctx, void *ptr )
+{
+	if ( ptr )
+		ctx->alloc( ctx->alloc_arg, ptr, 0 );
+}
+
+static void mib_vlog( mib_ctx_t *ctx, int level, const char *fmt,
+		      va_list ap )
+{
+	if ( ctx->log && level <= ctx->log_level )
+		ctx->log( ctx->log_arg, level, fmt, ap );
+}
+
+static void mib_error( mib_ctx_t *ctx, const char *fmt, ... )
+{
+	va_list ap;
+
+	va_start( ap, fmt );
+	mib_vlog( ctx, MIB_LOG_ERR, fmt, ap );
+	va_end( ap );
+}
+
+static void mib_debug( mib_ctx_t *ctx, const char *fmt, ... )
+{
+	va_list ap;
+
+	va_start( ap, fmt );
+	mib_vlog( ctx, MIB_LOG_DEBUG, fmt, ap );
+	va_end( ap );
+}
+
+static inline int mib_debug_on( mib_ctx_t *ctx )
+{
+	return ctx->log && ctx->log_level >= MIB_LOG_DEBUG;
+}
+
+#define MIB_HEX_ROW( h )						\
+	h "0", h "1", h "2", h "3", h "4", h "5", h "6", h "7",		\
+	h "8", h "9", h "a", h "b", h "c", h "d", h "e", h "f"
+
+const char mib_hex[ 256 ][ 2 ] = {
+	MIB_HEX_ROW( "0" ), MIB_HEX_ROW( "1" ), MIB_HEX_ROW( "2" ),
+	MIB_HEX_ROW( "3" ), MIB_HEX_ROW( "4" ), MIB_HEX_ROW( "5" ),
+	MIB_HEX_ROW( "6" ), MIB_HEX_ROW( "7" ), MIB_HEX_ROW( "8" ),
+	MIB_HEX_ROW( "9" ), MIB_HEX_ROW( "a" ), MIB_HEX_ROW( "b" ),
+	MIB_HEX_ROW( "c" ), MIB_HEX_ROW( "d" ), MIB_HEX_ROW( "e" ),
+	MIB_HEX_ROW( "f" ),
+};
+
+/* hex dump, 32 bytes per line in groups of 8 */
+static void mib_debug_hex( mib_ctx_t *ctx, const unsigned char *buf,
+			   uint32_t size )
+{
+	char line[ 32 * 3 + 3 * 2 + 2 ];
+	char *d = line;
+	uint32_t pos;
+
+	for ( pos = 0; pos < size; pos++ ) {
+		*d++ = ' ';
+		memcpy( d, mib_hex[ buf[pos] ], 2 );
+		d += 2;
+		if ( (pos & 31) == 31 ) {
+			*d = 0;
+			mib_debug( ctx, "%s\n", line );
+			d = line;
+		} else if ( (pos & 7) == 7 ) {
+			*d++ = ' ';
+			*d++ = ' ';
+		}
+	}
+	*d = 0;
+	mib_debug( ctx, "%s\n", line );
+}
+
+/*
+ * Decode into *buf of *cap bytes, growing it unless it is fixed. The
+ * size comes from the decoded header; the vendor decoders allocate
+ * factor * len, so a section claiming more is junk.
+ */
+static int mib_decode_buf( mib_ctx_t *ctx, const unsigned char *in,
+			   uint32_t len, unsigned int factor,
+			   unsigned char **buf, uint32_t *cap, int fixed )
+{
+	mib_hdr_t header;
+	unsigned char *p;
+	uint32_t need;
+
+	/* peek at the decoded header to learn the final size */
+	if ( lzss_decode( in, len, (unsigned char *)&header,
+			  sizeof(mib_hdr_t) ) != sizeof(mib_hdr_t) )
+		return MIB_ERR_DECODE;
+
+	need = sizeof(mib_hdr_t) + swap16(header.len);
+	if ( factor && (uint64_t)need > (uint64_t)factor * len )
+		return MIB_ERR_DECODE;
+
+	if ( need > *cap ) {
+		if ( fixed )
+			return MIB_ERR_NOMEM;
+		p = (unsigned char *)ctx->alloc( ctx->alloc_arg, *buf, need );
+		if ( !p )
+			return MIB_ERR_NOMEM;
+		*buf = p;
+		*cap = need;
+	}
+
+	return lzss_decode( in, len, *buf, need );
+}
+
+/*
+ * SWAR: the bytes of each word go into 16 bit lanes, even and odd
+ * bytes separately. A lane takes 128 words before it could carry into
+ * its neighbour, the lanes are folded down after every run of those.
+ */
+#define MIB_SUM_RUN		128
+
+unsigned char mib_sum( const unsigned char *data, uint32_t len )
+{
+	const uint64_t lo = 0x00ff00ff00ff00ffULL;
+	unsigned char sum = 0;
+	uint64_t w, acc;
+	uint32_t n;
+
+	while ( len >= sizeof(w) ) {
+		acc = 0;
+		for ( n = 0; n < MIB_SUM_RUN && len >= sizeof(w); n++ ) {
+			memcpy( &w, data, sizeof(w) );
+			acc += (w & lo) + (w >> 8 & lo);
+			data += sizeof(w);
+			len -= sizeof(w);
+		}
+		sum += (acc & 0xffff) + (acc >> 16 & 0xffff) +
+		       (acc >> 32 & 0xffff) + (acc >> 48);
+	}
+	while ( len-- )
+		sum += *data++;
+
+	return sum;
+}
+
+/*
+ * The checksum covers the data after the header, the length in the
+ * header includes the checksum byte at its end.
+ */
+static int mib_check_sum( mib_ctx_t *ctx, const unsigned char *data,
+			  uint32_t len )
+{
+	unsigned char sum = mib_sum( data, len );
+
+	if ( sum ) {
+		mib_debug( ctx, "checksum mismatch over 0x%x bytes: "
+			   "0x%02x\n", len, sum );
+		return MIB_ERR_CHECKSUM;
+	}
+	return 0;
+}
+
+/* the section decoded into ctx->dec: its header has to fit the output */
+static int mib_check_decoded( mib_ctx_t *ctx, int dec_len )
+{
+	uint32_t len = swap16( ((mib_hdr_t *)ctx->dec)->len );
+
+	if ( len > dec_len - sizeof(mib_hdr_t) ) {
+		mib_debug( ctx, "decoded 0x%x bytes, header says 0x%x\n",
+			   dec_len - (int)sizeof(mib_hdr_t), len );
+		return MIB_ERR_LENGTH;
+	}
+	return mib_check_sum( ctx, ctx->dec + sizeof(mib_hdr_t), len );
+}
+
+/* decode into ctx->dec, growing it unless it belongs to the caller */
+static int mib_ctx_decode( mib_ctx_t *ctx, unsigned char *in, uint32_t len )
+{
+	return mib_decode_buf( ctx, in, len, 0, &ctx->dec, &ctx->dec_cap,
+			       ctx->dec_fixed );
+}
+
+/*
+ * Plain sections: the board data stays where it is and every interface
+ * moves up to its place in mib_t. Going from the last interface down
+ * lets data be mib itself. Constant num and ac give every layout a
+ * copy routine of its own with fixed sizes.
+ */
+typedef char mib_wlan_offset_ok[
+		offsetof(mib_t, wlan) == MIB_WLAN_OFFSET ? 1 : -1 ];
+
+static inline void mib_layout_expand( mib_t *mib, const unsigned char *data,
+				      unsigned int num, unsigned int ac,
+				      unsigned int layout )
+{
+	const uint32_t size = ac ? sizeof(mib_wlan_t) : MIB_WLAN_BASE_SIZE;
+	unsigned int i;
+
+	memset( &mib->wlan[ num ], 0,
+		(NUM_WLAN_INTERFACE - num) * sizeof(mib_wlan_t) );
+	for ( i = num; i--; ) {
+		memmove( &mib->wlan[i], data + MIB_WLAN_OFFSET + i * size,
+			 size );
+		if ( !ac )
+			memset( (unsigned char *)&mib->wlan[i] +
+					MIB_WLAN_BASE_SIZE, 0,
+				sizeof(mib_wlan_t) - MIB_WLAN_BASE_SIZE );
+	}
+	memmove( mib, data, MIB_WLAN_OFFSET );
+	mib->wlan_num = num;
+	mib->layout = layout;
+}
+
+#define MIB_LAYOUT_COPY( name, num, ac )				\
+static void mib_layout_copy_##name( mib_t *mib,				\
+				    const unsigned char *data )		\
+{									\
+	mib_layout_expand( mib, data, num, ac, MIB_LAYOUT_##name );	\
+}
+MIB_LAYOUTS( MIB_LAYOUT_COPY )
+
+#define MIB_LAYOUT_DESC( name, num, ac )				\
+	[ MIB_LAYOUT_##name ] = { #name, num, ac,			\
+		MIB_WLAN_OFFSET + num * (ac ? sizeof(mib_wlan_t) :	\
+					      MIB_WLAN_BASE_SIZE),	\
+		mib_layout_copy_##name },
+const mib_layout_t mib_layouts[ MIB_LAYOUTS_NUM ] = {
+	[ MIB_LAYOUT_TLV ] = { "TLV", 0, 0, 0, NULL },
+	MIB_LAYOUTS( MIB_LAYOUT_DESC )
+};
+
+int mib_layout_select( uint32_t len )
+{
+	int i, best = -1;
+
+	for ( i = MIB_LAYOUT_TLV + 1; i < MIB_LAYOUTS_NUM; i++ ) {
+		/* Realtek tools add a checksum byte after the data */
+		if ( mib_layouts[i].size == len ||
+		     mib_layouts[i].size + 1 == len )
+			return i;
+		if ( mib_layouts[i].size < len &&
+		     (best < 0 || mib_layouts[i].size > mib_layouts[best].size) )
+			best = i;
+	}
+
+	return best;
+}
+
+/*
+ * Both headers and the payload come out of the same flash window, so
+ * this normally costs a single read.
+ */
+int mib_read( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+	      unsigned char **mib, uint32_t *size )
+{
+	*mib = NULL;
+	mib_hdr_t *header;
+	mib_hdr_compr_t *header_compr;
+	unsigned int len = 0;
+	unsigned int hlen;
+	int compression = 0;
+	unsigned char *sig = NULL;
+	uint64_t t = mib_now_ns();
+
+	header_compr = (mib_hdr_compr_t *)flash_map( fl, offset,
+						sizeof(mib_hdr_compr_t) );
+	if ( !header_compr ) {
+		mib_debug( ctx, "probe header failed: %m\n" );
+		return MIB_ERR_GENERIC;
+	}
+	header = (mib_hdr_t *)header_compr;
+
+	if ( !memcmp( MIB_HEADER_COMP_TAG,
+		      header->sig,
+		      MIB_COMPR_TAG_LEN ) )
+	{
+
+		mib_debug( ctx, "MIB is compressed!\n" );
+
+		sig = header_compr->sig;
+		len = swap32(header_compr->len);
+		compression = swap16(header_compr->factor);
+		hlen = sizeof(mib_hdr_compr_t);
+	} else if ( !memcmp( MIB_HEADER_TAG, header->sig, MIB_TAG_LEN ) ) {
+		sig = header->sig;
+		len = swap16(header->len);
+		hlen = sizeof(mib_hdr_t);
+	} else {
+		mib_debug( ctx, "Invalid MIB header!\n");
+		return MIB_ERR_GENERIC;
+	}
+
+	mib_debug( ctx, "Header info:\n" );
+	if ( compression ) {
+		mib_debug( ctx, "  signature: '%.6s'\n", sig );
+		mib_debug( ctx, "  compression factor: 0x%x\n", compression );
+	} else {
+		mib_debug( ctx, "  signature: '%.2s'\n", sig );
+	}
+	mib_debug( ctx, "  data size: 0x%x\n", len );
+	mib_stage( ctx, MIB_STAGE_HEADER, &t, hlen );
+
+	/* only goes back to the device if len runs past the read-ahead */
+	*mib = flash_map( fl, offset + hlen, len );
+	if ( !*mib ) {
+		mib_debug( ctx, "MIB read failed: %m\n" );
+		return errno == ENOMEM ? MIB_ERR_NOMEM : MIB_ERR_GENERIC;
+	}
+	mib_stage( ctx, MIB_STAGE_READ, &t, len );
+
+	if ( compression ) {
+		*size = len;
+		return MIB_ERR_COMPRESSED;
+	}
+
+	return len;
+}
+
+/*
+ * Run the reference decoder over the same input and compare the
+ * outputs byte for byte. The reference decoder may append a stray
+ * byte taken from past the end of the input, so only the part
+ * covered by the new decoder is compared.
+ */
+static int mib_compare_decoders( mib_ctx_t *ctx, unsigned char *in, uint32_t len,
+				 unsigned char *out, int out_len )
+{
+	unsigned char *ref = NULL;
+	int ref_len;
+	int i;
+
+	ref_len = mib_decode_ref( in, len, &ref, ctx->alloc,
+				  ctx->alloc_arg );
+	if ( ref_len < out_len ) {
+		mib_error( ctx, "Decoder mismatch: reference produced 0x%x bytes, "
+			"expected 0x%x\n", ref_len, out_len );
+		mib_free( ctx, ref );
+		return -1;
+	}
+
+	for ( i = 0; i < out_len; i++ ) {
+		if ( ref[i] != out[i] ) {
+			mib_error( ctx, "Decoder mismatch at 0x%x: 0x%02x != 0x%02x\n",
+				i, out[i], ref[i] );
+			mib_free( ctx, ref );
+			return -1;
+		}
+	}
+
+	mib_debug( ctx, "Decoders match (0x%x bytes)\n", out_len );
+	mib_free( ctx, ref );
+	return 0;
+}
+
+/*
+ * Direct indexed descriptor table: mibtbl_slot[] maps a TLV id to its
+ * entry in mibtbl_desc[], slot 0 means the id is not known.
+ */
+#define MIBTBL_SLOT( id, member )	MIBTBL_SLOT_##id,
+enum {
+	MIBTBL_SLOT_NONE,
+	MIBTBL_FIELDS( MIBTBL_SLOT, MIBTBL_SLOT )
+	MIBTBL_SLOTS
+};
+
+#define MIBTBL_INDEX( id, member )	[ id ] = MIBTBL_SLOT_##id,
+static const unsigned char mibtbl_slot[ MIB_HW_ID_MAX + 1 ] = {
+	MIBTBL_FIELDS( MIBTBL_INDEX, MIBTBL_INDEX )
+};
+
+#define MIBTBL_MIB( id, member )					\
+	[ MIBTBL_SLOT_##id ] = { offsetof(mib_t, member),		\
+				 sizeof(((mib_t *)0)->member), 0 },
+#define MIBTBL_WLAN( id, member )					\
+	[ MIBTBL_SLOT_##id ] = { offsetof(mib_t, wlan[0].member),	\
+				 sizeof(((mib_wlan_t *)0)->member), 1 },
+static const mibtbl_desc_t mibtbl_desc[ MIBTBL_SLOTS ] = {
+	MIBTBL_FIELDS( MIBTBL_MIB, MIBTBL_WLAN )
+};
+
+static inline const mibtbl_desc_t *mibtbl_lookup( unsigned int type )
+{
+	if ( type > MIB_HW_ID_MAX || !mibtbl_slot[ type ] )
+		return NULL;
+
+	return &mibtbl_desc[ mibtbl_slot[ type ] ];
+}
+
+/* mibtbl_want_t has one bit per slot */
+typedef char mibtbl_slots_fit[ MIBTBL_SLOTS <= 64 ? 1 : -1 ];
+
+void mibtbl_want_id( mibtbl_want_t *want, unsigned int type,
+		     unsigned int wlan )
+{
+	if ( type <= MIB_HW_ID_MAX && mibtbl_slot[ type ] &&
+	     wlan < NUM_WLAN_INTERFACE )
+		want->slots[ wlan ] |= 1ULL << mibtbl_slot[ type ];
+}
+
+static int mibtbl_want_empty( const mibtbl_want_t *want )
+{
+	unsigned int i;
+
+	for ( i = 0; i < NUM_WLAN_INTERFACE; i++ )
+		if ( want->slots[i] )
+			return 0;
+	return 1;
+}
+
+uint32_t mibtbl_want_end( const mibtbl_want_t *want )
+{
+	uint32_t end = 0, e;
+	unsigned int i, slot;
+
+	for ( i = 0; i < NUM_WLAN_INTERFACE; i++ ) {
+		for ( slot = 1; slot < MIBTBL_SLOTS; slot++ ) {
+			if ( !(want->slots[i] & (1ULL << slot)) )
+				continue;
+			e = mibtbl_desc[ slot ].offset + mibtbl_desc[ slot ].size;
+			if ( mibtbl_desc[ slot ].wlan )
+				e += i * sizeof(mib_wlan_t);
+			if ( e > end )
+				end = e;
+		}
+	}
+
+	return end;
+}
+
+/*
+ * Incremental TLV walk. The table may be fed in arbitrary pieces, so
+ * a header or a field value can be split between two calls.
+ *
+ * Every wlan interface comes in its own sub-table, so a table header
+ * seen after wlan fields were stored moves on to the next interface.
+ */
+typedef struct mibtbl_parser {
+	mib_ctx_t *ctx;
+	unsigned char *mib;
+	mibtbl_want_t want;	/* fields still missing */
+	int early_exit;		/* stop once want is empty */
+	uint32_t left;		/* table bytes not seen yet */
+	unsigned char hdr[ sizeof(mibtbl_t) ];
+	unsigned int hdr_have;
+	int in_field;
+	unsigned int type;
+	uint32_t field_left;	/* value bytes still to come */
+	unsigned char *dst;	/* where they go, NULL to drop them */
+	uint32_t dst_left;
+	unsigned int slot;
+	unsigned int wlan;
+	int wlan_used;
+	mibtbl_stats_t *stats;	/* only while analysing */
+} mibtbl_parser_t;
+
+static void mibtbl_parser_init( mibtbl_parser_t *p, mib_ctx_t *ctx,
+				unsigned char *mib, uint32_t size,
+				const mibtbl_want_t *want )
+{
+	memset( p, 0, sizeof(mibtbl_parser_t) );
+	p->ctx = ctx;
+	p->mib = mib;
+	p->left = size;
+	if ( want ) {
+		p->want = *want;
+		p->early_exit = 1;
+	}
+}
+
+static void mibtbl_stats_add( mibtbl_stats_t *st, unsigned int type,
+			      unsigned int len, const mibtbl_desc_t *desc )
+{
+	mibtbl_type_stats_t *t;
+	unsigned int i;
+
+	st->fields++;
+	st->bytes += len;
+	if ( !desc )
+		st->unknown++;
+	else if ( len > desc->size )
+		st->truncated++;
+
+	for ( i = 0; i < st->ntypes; i++ )
+		if ( st->types[i].type == type )
+			break;
+	if ( i == st->ntypes ) {
+		if ( i == MIBTBL_STATS_TYPES ) {
+			st->overflow++;
+			return;
+		}
+		st->ntypes++;
+		t = &st->types[i];
+		t->type = type;
+		t->known = desc != NULL;
+		t->min = len;
+	}
+
+	t = &st->types[i];
+	t->count++;
+	t->bytes += len;
+	if ( len < t->min )
+		t->min = len;
+	if ( len > t->max )
+		t->max = len;
+}
+
+static void mibtbl_field_start( mibtbl_parser_t *p, unsigned int len )
+{
+	const mibtbl_desc_t *desc = mibtbl_lookup( p->type );
+
+	p->in_field = 1;
+	p->field_left = len;
+	p->dst = NULL;
+	p->dst_left = 0;
+	p->slot = 0;
+
+	if ( p->stats && p->type )
+		mibtbl_stats_add( p->stats, p->type, len, desc );
+
+	if ( desc ) {
+		if ( desc->wlan && p->wlan >= NUM_WLAN_INTERFACE )
+			return;
+
+		p->dst = p->mib + desc->offset;
+		if ( desc->wlan ) {
+			p->dst += p->wlan * sizeof(mib_wlan_t);
+			p->wlan_used = 1;
+		}
+		p->dst_left = len;
+		if ( len > desc->size ) {
+			mib_debug( p->ctx, "field (type %i) too long: %u > %u\n",
+				p->type, len, desc->size );
+			p->dst_left = desc->size;
+		}
+		p->slot = mibtbl_slot[ p->type ];
+	} else if ( p->type == 0 ) {
+		mib_debug( p->ctx, "End of MIB tables!\n");
+	} else {
+		mib_debug( p->ctx, "unknown field (type %i) found,"
+			"containing data:\n", p->type );
+	}
+}
+
+/* field value complete, returns 1 if nothing else is wanted */
+static int mibtbl_field_end( mibtbl_parser_t *p )
+{
+	p->in_field = 0;
+
+	if ( !p->slot || !p->dst )
+		return 0;
+
+	if ( mibtbl_desc[ p->slot ].wlan )
+		p->want.slots[ p->wlan ] &= ~(1ULL << p->slot);
+	else
+		p->want.slots[ 0 ] &= ~(1ULL << p->slot);
+
+	return p->early_exit && mibtbl_want_empty( &p->want );
+}
+
+/*
+ * Feed the next n table bytes. Returns 1 when the walk is over: every
+ * wanted field was seen, the table ended or it turned out broken.
+ */
+static int mibtbl_parser_feed( mibtbl_parser_t *p,
+			       const unsigned char *buf, uint32_t n )
+{
+	uint32_t take;
+	mibtbl_t mibtbl;
+	unsigned int len;
+
+	if ( n > p->left )
+		n = p->left;
+
+	while ( n ) {
+		if ( !p->in_field ) {
+			take = sizeof(mibtbl_t) - p->hdr_have;
+			if ( take > n )
+				take = n;
+			memcpy( p->hdr + p->hdr_have, buf, take );
+			p->hdr_have += take;
+			buf += take;
+			n -= take;
+			p->left -= take;
+			if ( p->hdr_have < sizeof(mibtbl_t) )
+				break;
+			p->hdr_have = 0;
+
+			memcpy( &mibtbl, p->hdr, sizeof(mibtbl_t) );
+			p->type = swap16(mibtbl.type);
+			len = swap16(mibtbl.size);
+
+			/* does 0xc900 mean the end of a table? */
+			if( p->type > MIB_TABLE_LIST ) {
+				mib_debug( p->ctx, "Next table with size 0x%02x!\n", len );
+				if ( p->stats )
+					p->stats->tables++;
+				if ( p->wlan_used ) {
+					p->wlan++;
+					p->wlan_used = 0;
+					if ( p->wlan == NUM_WLAN_INTERFACE )
+						mib_debug( p->ctx, "no room for wlan%u, "
+							"skipping its fields\n",
+							p->wlan );
+				}
+				continue;
+			}
+
+			if ( len > p->left ) {
+				mib_debug( p->ctx, "field (type %i) runs past the end of "
+					"the table\n", p->type );
+				p->left = 0;
+				return 1;
+			}
+
+			mibtbl_field_start( p, len );
+		}
+
+		take = p->field_left < n ? p->field_left : n;
+		if ( p->dst_left ) {
+			uint32_t copy = take < p->dst_left ? take : p->dst_left;
+			memcpy( p->dst, buf, copy );
+			p->dst += copy;
+			p->dst_left -= copy;
+		} else if ( mib_debug_on( p->ctx ) && !p->slot && p->type ) {
+			mib_debug_hex( p->ctx, buf, take );
+		}
+		buf += take;
+		n -= take;
+		p->left -= take;
+		p->field_left -= take;
+
+		if ( !p->field_left && mibtbl_field_end( p ) )
+			return 1;
+	}
+
+	/* a header that can never be completed ends the walk too */
+	return p->left < sizeof(mibtbl_t) - p->hdr_have && !p->in_field;
+}
+
+/* record how many interfaces the walk stored fields for */
+static void mibtbl_parser_finish( mibtbl_parser_t *p )
+{
+	mib_t *mib = (mib_t *)p->mib;
+	unsigned int num = p->wlan + p->wlan_used;
+
+	mib->wlan_num = num < NUM_WLAN_INTERFACE ? num : NUM_WLAN_INTERFACE;
+	mib->layout = MIB_LAYOUT_TLV;
+}
+
+static void mibtbl_to_struct( mib_ctx_t *ctx, unsigned char *tbl,
+			      uint32_t size, unsigned char *mib )
+{
+	if ( !tbl || ! mib )
+		return;
+
+	mibtbl_parser_t parser;
+
+	mibtbl_parser_init( &parser, ctx, mib, size, NULL );
+	mibtbl_parser_feed( &parser, tbl, size );
+	mibtbl_parser_finish( &parser );
+}
+
+int mib_load( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+	      int compare, mib_t **mib )
+{
+	unsigned char *buf = NULL;
+	uint32_t size = 0;
+	uint64_t t;
+	int mib_len, layout, err;
+
+	mib_len = mib_read( ctx, fl, offset, &buf, &size );
+	if ( mib_len < 0 && mib_len != MIB_ERR_COMPRESSED )
+		return mib_len;
+
+	if ( mib_len == MIB_ERR_COMPRESSED ) {
+		t = mib_now_ns();
+		mib_len = mib_ctx_decode( ctx, buf, size );
+		if ( mib_len == MIB_ERR_NOMEM ) {
+			mib_debug( ctx, "MIB does not fit the decode buffer\n" );
+			return MIB_ERR_NOMEM;
+		}
+		if ( mib_len < (int)sizeof(mib_hdr_t) ) {
+			mib_debug( ctx, "MIB decode failed\n" );
+			return MIB_ERR_DECODE;
+		}
+		mib_stage( ctx, MIB_STAGE_DECODE, &t, mib_len );
+
+		if ( compare &&
+		     mib_compare_decoders( ctx, buf, size, ctx->dec, mib_len ) )
+			return MIB_ERR_MISMATCH;
+
+		err = mib_check_decoded( ctx, mib_len );
+		if ( err )
+			return err;
+
+		mib_debug( ctx, "Compressed size: %i\n", size );
+		mib_hdr_t *header = (mib_hdr_t *)ctx->dec;
+		mib_debug( ctx, "Header signature: '%.2s'\n", header->sig );
+		mib_debug( ctx, "Length from header: 0x%x\n", swap16(header->len) );
+		mib_debug( ctx, "Decoded length: 0x%x\n", mib_len );
+		mib_debug( ctx, "Expected mininum len: 0x%x\n", (int)MIB_SIZE_MIN );
+		mib_debug( ctx, "Decoded data:\n" );
+		if ( mib_debug_on( ctx ) )
+			mib_debug_hex( ctx, ctx->dec + sizeof(mib_hdr_t),
+				       mib_len - sizeof(mib_hdr_t) );
+
+		t = mib_now_ns();
+		memset( &ctx->mib, 0, sizeof(mib_t) );
+		mibtbl_to_struct( ctx, ctx->dec + sizeof(mib_hdr_t),
+				  mib_len - sizeof(mib_hdr_t),
+				  (unsigned char *)&ctx->mib );
+		mib_stage( ctx, MIB_STAGE_PARSE, &t,
+			   mib_len - sizeof(mib_hdr_t) );
+		*mib = &ctx->mib;
+	} else {
+		layout = mib_layout_select( mib_len );
+		if ( layout < 0 ) {
+			mib_debug( ctx, "MIB length invalid!\n" );
+			return MIB_ERR_LENGTH;
+		}
+		mib_debug( ctx, "layout: %s\n", mib_layouts[ layout ].name );
+		/* with room to spare the last byte is the checksum */
+		if ( (uint32_t)mib_len > mib_layouts[ layout ].size &&
+		     (err = mib_check_sum( ctx, buf, mib_len )) )
+			return err;
+		t = mib_now_ns();
+		mib_layouts[ layout ].copy( &ctx->mib, buf );
+		mib_stage( ctx, MIB_STAGE_PARSE, &t,
+			   mib_layouts[ layout ].size );
+		*mib = &ctx->mib;
+	}
+
+	if ( mib_len < (int)MIB_SIZE_MIN ) {
+		mib_debug( ctx, "MIB length invalid!\n" );
+		return MIB_ERR_LENGTH;
+	}
+
+	mib_debug( ctx, "board version: 0x%02x\n", (*mib)->board_ver );
+
+	return mib_len;
+}
+
+int mib_verify( mib_ctx_t *ctx, flash_t *fl, unsigned int offset )
+{
+	unsigned char *buf = NULL;
+	uint32_t size = 0;
+	int len, layout, err;
+
+	len = mib_read( ctx, fl, offset, &buf, &size );
+	if ( len == MIB_ERR_COMPRESSED ) {
+		len = mib_ctx_decode( ctx, buf, size );
+		if ( len == MIB_ERR_NOMEM )
+			return MIB_ERR_NOMEM;
+		if ( len < (int)sizeof(mib_hdr_t) )
+			return MIB_ERR_DECODE;
+		err = mib_check_decoded( ctx, len );
+		return err ? err : swap16( ((mib_hdr_t *)ctx->dec)->len );
+	}
+	if ( len < 0 )
+		return len;
+
+	layout = mib_layout_select( len );
+	if ( layout < 0 )
+		return MIB_ERR_LENGTH;
+	if ( (uint32_t)len <= mib_layouts[ layout ].size )
+		return 0;
+
+	err = mib_check_sum( ctx, buf, len );
+	return err ? err : len;
+}
+
+int mib_analyze( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+		 mib_analysis_t *an )
+{
+	mibtbl_parser_t parser;
+	unsigned char *buf = NULL;
+	mib_hdr_compr_t *header;
+	uint32_t size = 0;
+	int len;
+
+	memset( an, 0, sizeof(mib_analysis_t) );
+
+	len = mib_read( ctx, fl, offset, &buf, &size );
+	if ( len < 0 && len != MIB_ERR_COMPRESSED )
+		return len;
+
+	if ( len != MIB_ERR_COMPRESSED ) {
+		an->hdr_len = sizeof(mib_hdr_t);
+		an->len = len;
+		an->data_len = sizeof(mib_hdr_t) + len;
+		return 0;
+	}
+
+	/* mib_read() left the header in the same window as the payload */
+	header = (mib_hdr_compr_t *)(buf - sizeof(mib_hdr_compr_t));
+	an->compressed = 1;
+	an->hdr_len = sizeof(mib_hdr_compr_t);
+	an->len = size;
+	an->factor = swap16(header->factor);
+
+	len = mib_ctx_decode( ctx, buf, size );
+	if ( len == MIB_ERR_NOMEM )
+		return MIB_ERR_NOMEM;
+	if ( len < (int)sizeof(mib_hdr_t) )
+		return MIB_ERR_DECODE;
+	an->data_len = len;
+
+	lzss_analyze( buf, size, len, &an->lzss );
+
+	memset( &ctx->mib, 0, sizeof(mib_t) );
+	mibtbl_parser_init( &parser, ctx, (unsigned char *)&ctx->mib,
+			    len - sizeof(mib_hdr_t), NULL );
+	parser.stats = &an->tbl;
+	mibtbl_parser_feed( &parser, ctx->dec + sizeof(mib_hdr_t),
+			    len - sizeof(mib_hdr_t) );
+
+	return 0;
+}
+
+const char *const mib_sect_names[ MIB_SECTS ] = { "hs", "ds", "cs" };
+
+/*
+ * Check the header at p for a section of the settings area. Returns
+ * its MIB_SECT_* and sets the header and payload sizes, or -1.
+ */
+static int mib_area_header( const unsigned char *p, uint32_t avail,
+			    uint32_t *hlen, uint32_t *len )
+{
+	const mib_hdr_compr_t *compr = (const mib_hdr_compr_t *)p;
+	const unsigned char *type = p + MIB_COMPR_TAG_LEN;
+	int kind;
+
+	if ( avail >= sizeof(mib_hdr_compr_t) &&
+	     !memcmp( p, MIB_HEADER_COMP_TAG, MIB_COMPR_TAG_LEN ) ) {
+		if ( !memcmp( type, MIB_HEADER_COMPHS_TAG, 2 ) )
+			kind = MIB_SECT_HS;
+		else if ( !memcmp( type, MIB_HEADER_COMPDS_TAG, 2 ) )
+			kind = MIB_SECT_DS;
+		else if ( !memcmp( type, MIB_HEADER_COMPCS_TAG, 2 ) )
+			kind = MIB_SECT_CS;
+		else
+			return -1;
+		*hlen = sizeof(mib_hdr_compr_t);
+		*len = swap32( compr->len );
+		if ( !*len || !compr->factor )
+			return -1;
+	} else if ( avail >= sizeof(mib_hdr_t) &&
+		    !memcmp( p, MIB_HEADER_TAG, MIB_TAG_LEN ) ) {
+		kind = MIB_SECT_HS;
+		*hlen = sizeof(mib_hdr_t);
+		*len = swap16( ((const mib_hdr_t *)p)->len );
+		if ( mib_layout_select( *len ) < 0 )
+			return -1;
+	} else {
+		return -1;
+	}
+
+	return *len <= avail - *hlen ? kind : -1;
+}
+
+/* decode or copy the section at p, which mib_area_header() accepted */
+static int mib_area_sect( mib_ctx_t *ctx, mib_area_t *area, int kind,
+			  const unsigned char *p, uint32_t hlen, uint32_t len )
+{
+	mib_area_sect_t *sect = &area->sect[ kind ];
+	mibtbl_parser_t parser;
+	uint32_t cap = 0;
+	uint64_t t = mib_now_ns();
+	int n;
+
+	if ( hlen == sizeof(mib_hdr_t) ) {
+		n = mib_layout_select( len );
+		/* with room to spare the last byte is the checksum */
+		if ( len > mib_layouts[ n ].size &&
+		     mib_check_sum( ctx, p + hlen, len ) )
+			return MIB_ERR_CHECKSUM;
+		mib_layouts[ n ].copy( &area->hs, p + hlen );
+		mib_stage( ctx, MIB_STAGE_PARSE, &t, mib_layouts[ n ].size );
+		sect->data_len = hlen + len;
+		return 0;
+	}
+
+	n = mib_decode_buf( ctx, p + hlen, len,
+			    swap16( ((const mib_hdr_compr_t *)p)->factor ),
+			    &sect->data, &cap, 0 );
+	if ( n < (int)sizeof(mib_hdr_t) ) {
+		mib_free( ctx, sect->data );
+		sect->data = NULL;
+		return n == MIB_ERR_NOMEM ? n : MIB_ERR_DECODE;
+	}
+	mib_stage( ctx, MIB_STAGE_DECODE, &t, n );
+
+	hlen = swap16( ((mib_hdr_t *)sect->data)->len );
+	if ( hlen > n - sizeof(mib_hdr_t) ||
+	     mib_check_sum( ctx, sect->data + sizeof(mib_hdr_t), hlen ) ) {
+		mib_free( ctx, sect->data );
+		sect->data = NULL;
+		return MIB_ERR_CHECKSUM;
+	}
+	sect->compressed = 1;
+	sect->data_len = n;
+
+	if ( kind == MIB_SECT_HS ) {
+		mibtbl_parser_init( &parser, ctx, (unsigned char *)&area->hs,
+				    n - sizeof(mib_hdr_t), NULL );
+		mibtbl_parser_feed( &parser, sect->data + sizeof(mib_hdr_t),
+				    n - sizeof(mib_hdr_t) );
+		mibtbl_parser_finish( &parser );
+		mib_stage( ctx, MIB_STAGE_PARSE, &t, n - sizeof(mib_hdr_t) );
+	}
+
+	return 0;
+}
+
+int mib_area_load( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+		   uint32_t size, mib_area_t *area )
+{
+	unsigned char *img;
+	uint32_t pos = 0, hlen, len;
+	uint64_t t = mib_now_ns();
+	int kind, err, found = 0;
+
+	memset( area, 0, sizeof(mib_area_t) );
+
+	if ( fl->size > (off_t)offset &&
+	     (off_t)size > fl->size - (off_t)offset )
+		size = fl->size - offset;
+
+	/* one read covers every section */
+	img = flash_map( fl, offset, size );
+	if ( !img ) {
+		mib_debug( ctx, "Settings area read failed: %m\n" );
+		return errno == ENOMEM ? MIB_ERR_NOMEM : MIB_ERR_GENERIC;
+	}
+	mib_stage( ctx, MIB_STAGE_READ, &t, size );
+
+	while ( (pos = mib_sig_search( img, size, pos )) < size ) {
+		kind = mib_area_header( img + pos, size - pos, &hlen, &len );
+		if ( kind < 0 || area->sect[ kind ].data_len ) {
+			pos++;
+			continue;
+		}
+
+		err = mib_area_sect( ctx, area, kind, img + pos, hlen, len );
+		if ( err == MIB_ERR_NOMEM ) {
+			mib_area_free( ctx, area );
+			return err;
+		}
+		if ( err ) {
+			mib_debug( ctx, "%s at 0x%x does not decode\n",
+				mib_sect_names[ kind ], offset + pos );
+			pos++;
+			continue;
+		}
+
+		area->sect[ kind ].offset = offset + pos;
+		area->sect[ kind ].len = len;
+		mib_debug( ctx, "%s at 0x%x: 0x%x bytes, 0x%x decoded\n",
+			mib_sect_names[ kind ], offset + pos, len,
+			area->sect[ kind ].data_len );
+		found++;
+		/* sections do not overlap */
+		pos += hlen + len;
+	}
+
+	return found ? found : MIB_ERR_GENERIC;
+}
+
+void mib_area_free( mib_ctx_t *ctx, mib_area_t *area )
+{
+	int i;
+
+	for ( i = 0; i < MIB_SECTS; i++ ) {
+		mib_free( ctx, area->sect[i].data );
+		area->sect[i].data = NULL;
+	}
+}
+
+const unsigned char *mibtbl_next( const unsigned char *tbl, uint32_t size,
+				  uint32_t *pos, unsigned int *type,
+				  uint32_t *len )
+{
+	mibtbl_t mibtbl;
+	const unsigned char *val;
+
+	while ( *pos + sizeof(mibtbl_t) <= size ) {
+		memcpy( &mibtbl, tbl + *pos, sizeof(mibtbl_t) );
+		*type = swap16(mibtbl.type);
+		*len = swap16(mibtbl.size);
+		*pos += sizeof(mibtbl_t);
+
+		if ( *type > MIB_TABLE_LIST )
+			continue;
+		if ( !*type || *len > size - *pos )
+			break;
+
+		val = tbl + *pos;
+		*pos += *len;
+		return val;
+	}
+
+	*pos = size;
+	return NULL;
+}
+
+int mib_section_fingerprint( mib_ctx_t *ctx, flash_t *fl,
+			     unsigned int offset, uint64_t *fp )
+{
+	unsigned char hdr[ sizeof(mib_hdr_compr_t) ];
+	unsigned char *buf;
+	uint32_t size = 0;
+	int len;
+
+	buf = flash_map( fl, offset, sizeof(hdr) );
+	if ( !buf )
+		return MIB_ERR_GENERIC;
+	memcpy( hdr, buf, sizeof(hdr) );
+
+	len = mib_read( ctx, fl, offset, &buf, &size );
+	if ( len < 0 && len != MIB_ERR_COMPRESSED )
+		return len;
+	if ( len != MIB_ERR_COMPRESSED )
+		size = len;
+
+	*fp = mib_fingerprint( MIB_FP_INIT, hdr, sizeof(hdr) );
+	*fp = mib_fingerprint( *fp, buf, size );
+
+	return 0;
+}
+
+/*
+ * Fused read -> decode -> parse pipeline for field queries. Pipes are
+ * read sequentially in small chunks, anything seekable is mapped
+ * through the flash window. The walk stops as soon as every wanted
+ * field has been stored in *mib, unless the checksum is to be verified:
+ * that takes the whole section.
+ */
+#define MIB_STREAM_CHUNK	512
+
+typedef struct mib_stream {
+	mib_ctx_t *ctx;
+	mib_hdr_t header;	/* decoded section header */
+	unsigned int have;
+	int invalid;
+	int parsed;		/* every wanted field is in */
+	int verify;		/* sum the whole table */
+	uint32_t left;		/* table bytes not summed yet */
+	unsigned char sum;
+	mibtbl_parser_t parser;
+	mib_t *mib;
+	const mibtbl_want_t *want;
+} mib_stream_t;
+
+typedef char mib_stream_fits_arena[
+		sizeof(mib_stream_t) <= MIB_ARENA_STREAM ? 1 : -1 ];
+
+static int read_full( int fd, void *buf, uint32_t len )
+{
+	unsigned char *p = (unsigned char *)buf;
+	ssize_t n;
+
+	while ( len ) {
+		n = read( fd, p, len );
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return -1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* get to offset on files and devices as well as on pipes */
+static int skip_to( int fd, unsigned int offset )
+{
+	unsigned char tmp[ MIB_STREAM_CHUNK ];
+	uint32_t n;
+
+	if ( lseek( fd, offset, SEEK_SET ) == (off_t)offset )
+		return 0;
+	if ( errno != ESPIPE )
+		return -1;
+
+	while ( offset ) {
+		n = offset < sizeof(tmp) ? offset : sizeof(tmp);
+		if ( read_full( fd, tmp, n ) )
+			return -1;
+		offset -= n;
+	}
+
+	return 0;
+}
+
+/* decoded bytes: the section header first, then the TLV table */
+static int mib_stream_sink( void *arg, const unsigned char *buf,
+			    uint32_t len )
+{
+	mib_stream_t *st = (mib_stream_t *)arg;
+	uint32_t take;
+	uint64_t t;
+
+	if ( st->have < sizeof(mib_hdr_t) ) {
+		take = sizeof(mib_hdr_t) - st->have;
+		if ( take > len )
+			take = len;
+		memcpy( (unsigned char *)&st->header + st->have, buf, take );
+		st->have += take;
+		buf += take;
+		len -= take;
+		if ( st->have < sizeof(mib_hdr_t) )
+			return 0;
+
+		mib_debug( st->ctx, "Header signature: '%.2s'\n", st->header.sig );
+		mib_debug( st->ctx, "Length from header: 0x%x\n",
+			swap16(st->header.len) );
+		if ( sizeof(mib_hdr_t) + swap16(st->header.len) <
+							MIB_SIZE_MIN ) {
+			mib_debug( st->ctx, "MIB length invalid!\n" );
+			st->invalid = 1;
+			return 1;
+		}
+		mibtbl_parser_init( &st->parser, st->ctx,
+				    (unsigned char *)st->mib,
+				    swap16(st->header.len), st->want );
+		st->left = swap16(st->header.len);
+	}
+
+	if ( st->verify ) {
+		take = len < st->left ? len : st->left;
+		st->sum += mib_sum( buf, take );
+		st->left -= take;
+	}
+
+	if ( !st->parsed ) {
+		t = mib_now_ns();
+		st->parsed = mibtbl_parser_feed( &st->parser, buf, len );
+		mib_stage( st->ctx, MIB_STAGE_PARSE, &t, len );
+	}
+
+	return st->verify ? !st->left : st->parsed;
+}
+
+/*
+ * Where the stream comes from: pipes are read in MIB_STREAM_CHUNK
+ * pieces, seekable inputs are taken straight out of the flash window.
+ */
+typedef struct mib_src {
+	flash_t *fl;		/* NULL for pipes */
+	int fd;
+	off_t pos;
+	unsigned char chunk[ MIB_STREAM_CHUNK ];
+} mib_src_t;
+
+/* up to len of the next bytes, *n says how many */
+static const unsigned char *mib_src_next( mib_src_t *src, uint32_t len,
+					  uint32_t *n )
+{
+	const unsigned char *p;
+
+	if ( src->fl ) {
+		*n = len;
+		p = flash_map( src->fl, src->pos, len );
+	} else {
+		*n = len < sizeof(src->chunk) ? len : sizeof(src->chunk);
+		p = read_full( src->fd, src->chunk, *n ) ? NULL : src->chunk;
+	}
+	if ( p )
+		src->pos += *n;
+
+	return p;
+}
+
+static int mib_src_read( mib_src_t *src, void *buf, uint32_t len )
+{
+	const unsigned char *p;
+	uint32_t n;
+
+	if ( !src->fl )
+		return read_full( src->fd, buf, len );
+
+	p = mib_src_next( src, len, &n );
+	if ( !p )
+		return -1;
+	memcpy( buf, p, n );
+
+	return 0;
+}
+
+/* sum a plain section: the head already read, the rest from src */
+static int mib_stream_sum( mib_ctx_t *ctx, mib_src_t *src,
+			   const unsigned char *head, uint32_t have,
+			   uint32_t rest )
+{
+	const unsigned char *p;
+	unsigned char sum = mib_sum( head, have );
+	uint32_t n, len = have + rest;
+
+	while ( rest ) {
+		p = mib_src_next( src, rest, &n );
+		if ( !p ) {
+			mib_debug( ctx, "MIB read failed\n" );
+			return MIB_ERR_GENERIC;
+		}
+		sum += mib_sum( p, n );
+		rest -= n;
+	}
+	if ( sum ) {
+		mib_debug( ctx, "checksum mismatch over 0x%x bytes: 0x%02x\n",
+			   len, sum );
+		return MIB_ERR_CHECKSUM;
+	}
+	return 0;
+}
+
+static int mib_stream_src( mib_ctx_t *ctx, mib_src_t *src,
+			   const mibtbl_want_t *want, uint32_t end,
+			   int verify, mib_t *mib )
+{
+	const unsigned char *chunk;
+	mib_hdr_compr_t header;
+	mib_stream_t *st;
+	lzss_stream_t *lz;
+	uint32_t len, n;
+	uint64_t t = mib_now_ns(), parse;
+	int err = 0, layout;
+
+	memset( mib, 0, sizeof(mib_t) );
+
+	if ( mib_src_read( src, &header, sizeof(mib_hdr_t) ) ) {
+		mib_debug( ctx, "probe header failed\n" );
+		return MIB_ERR_GENERIC;
+	}
+
+	if ( !memcmp( MIB_HEADER_TAG, header.sig, MIB_TAG_LEN ) ) {
+		len = swap16( ((mib_hdr_t *)&header)->len );
+		mib_debug( ctx, "  signature: '%.2s'\n", header.sig );
+		mib_debug( ctx, "  data size: 0x%x\n", len );
+		layout = mib_layout_select( len );
+		if ( layout < 0 ) {
+			mib_debug( ctx, "MIB length invalid!\n" );
+			return MIB_ERR_LENGTH;
+		}
+		mib_debug( ctx, "  layout: %s\n", mib_layouts[ layout ].name );
+		mib_stage( ctx, MIB_STAGE_HEADER, &t, sizeof(mib_hdr_t) );
+
+		/*
+		 * The board data and the first interface sit at the same
+		 * place in every layout, those are read no further than the
+		 * last wanted field. Anything else takes the whole section,
+		 * as does verifying a section with a checksum byte.
+		 */
+		if ( verify && len > mib_layouts[ layout ].size ) {
+			end = mib_layouts[ layout ].size;
+		} else {
+			verify = 0;
+			if ( end > MIB_SIZE_MIN )
+				end = mib_layouts[ layout ].size;
+		}
+		if ( mib_src_read( src, mib, end ) ) {
+			mib_debug( ctx, "MIB read failed\n" );
+			return MIB_ERR_GENERIC;
+		}
+		mib_stage( ctx, MIB_STAGE_READ, &t, end );
+		if ( verify ) {
+			err = mib_stream_sum( ctx, src, (unsigned char *)mib,
+					      end, len - end );
+			if ( err )
+				return err;
+			mib_stage( ctx, MIB_STAGE_READ, &t, len - end );
+		}
+		if ( end == mib_layouts[ layout ].size ) {
+			mib_layouts[ layout ].copy( mib, (unsigned char *)mib );
+			mib_stage( ctx, MIB_STAGE_PARSE, &t, end );
+		} else {
+			mib->wlan_num = mib_layouts[ layout ].wlan_num;
+			mib->layout = layout;
+		}
+		return len;
+	}
+
+	if ( memcmp( MIB_HEADER_COMP_TAG, header.sig, MIB_COMPR_TAG_LEN ) ||
+	     mib_src_read( src, (unsigned char *)&header + sizeof(mib_hdr_t),
+			   sizeof(mib_hdr_compr_t) - sizeof(mib_hdr_t) ) ) {
+		mib_debug( ctx, "Invalid MIB header!\n");
+		return MIB_ERR_GENERIC;
+	}
+
+	len = swap32(header.len);
+	mib_debug( ctx, "  signature: '%.6s'\n", header.sig );
+	mib_debug( ctx, "  data size: 0x%x\n", len );
+	mib_stage( ctx, MIB_STAGE_HEADER, &t, sizeof(mib_hdr_compr_t) );
+
+	st = (mib_stream_t *)mib_alloc( ctx, sizeof(mib_stream_t) );
+	lz = (lzss_stream_t *)mib_alloc( ctx, sizeof(lzss_stream_t) );
+	if ( !st || !lz ) {
+		err = MIB_ERR_NOMEM;
+		goto out;
+	}
+	memset( st, 0, sizeof(mib_stream_t) );
+	st->ctx = ctx;
+	st->mib = mib;
+	st->want = want;
+	st->verify = verify;
+	lzss_stream_init( lz );
+
+	while ( len ) {
+		t = mib_now_ns();
+		chunk = mib_src_next( src, len, &n );
+		if ( !chunk ) {
+			mib_debug( ctx, "MIB read failed\n" );
+			err = MIB_ERR_GENERIC;
+			goto out;
+		}
+		len -= n;
+		mib_stage( ctx, MIB_STAGE_READ, &t, n );
+
+		/* the sink runs inside the decoder, keep its time apart */
+		parse = ctx->stats.ns[ MIB_STAGE_PARSE ];
+		n = lzss_stream_decode( lz, chunk, n, mib_stream_sink, st );
+		t += ctx->stats.ns[ MIB_STAGE_PARSE ] - parse;
+		mib_stage( ctx, MIB_STAGE_DECODE, &t, 0 );
+		if ( n )
+			break;
+	}
+	ctx->stats.bytes[ MIB_STAGE_DECODE ] += lz->pos;
+
+	if ( st->invalid )
+		err = MIB_ERR_LENGTH;
+	else if ( st->have < sizeof(mib_hdr_t) )
+		err = MIB_ERR_DECODE;
+	else if ( st->verify && st->left )
+		err = MIB_ERR_LENGTH;
+	else if ( st->sum ) {
+		mib_debug( ctx, "checksum mismatch over 0x%x bytes: 0x%02x\n",
+			swap16(st->header.len), st->sum );
+		err = MIB_ERR_CHECKSUM;
+	} else
+		mibtbl_parser_finish( &st->parser );
+
+	if ( !err )
+		mib_debug( ctx, "Stopped after 0x%x of 0x%x compressed bytes\n",
+			swap32(header.len) - len, swap32(header.len) );
+
+out:
+	mib_free( ctx, lz );
+	mib_free( ctx, st );
+	return err;
+}
+
+int mib_stream_load( mib_ctx_t *ctx, int fd, unsigned int offset,
+		     const mibtbl_want_t *want, uint32_t end, int verify,
+		     mib_t *mib )
+{
+	mib_src_t src;
+
+	if ( skip_to( fd, offset ) ) {
+		mib_debug( ctx, "probe header failed\n" );
+		return MIB_ERR_GENERIC;
+	}
+	src.fl = NULL;
+	src.fd = fd;
+	src.pos = offset;
+
+	return mib_stream_src( ctx, &src, want, end, verify, mib );
+}
+
+int mib_stream_map( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+		    const mibtbl_want_t *want, uint32_t end, int verify,
+		    mib_t *mib )
+{
+	mib_src_t src;
+
+	src.fl = fl;
+	src.fd = -1;
+	src.pos = offset;
+
+	return mib_stream_src( ctx, &src, want, end, verify, mib );
+}
+
+const char *mib_strerror( int err )
+{
+	switch ( err ) {
+	case MIB_ERR_DECODE:
+		return "decode failed";
+	case MIB_ERR_MISMATCH:
+		return "decoder mismatch";
+	case MIB_ERR_LENGTH:
+		return "MIB length invalid";
+	case MIB_ERR_NOMEM:
+		return "out of memory";
+	case MIB_ERR_IO:
+		return "read error";
+	case MIB_ERR_VALUE:
+		return "invalid field value";
+	case MIB_ERR_MISSING:
+		return "field not stored in this section";
+	case MIB_ERR_CHECKSUM:
+		return "checksum mismatch";
+	case MIB_ERR_GENERIC:
+	default:
+		return "no valid MIB found";
+	}
+}
+
+
+int mib_load_file( mib_ctx_t *ctx, const char *path, unsigned int offset,
+		   mib_t *mib )
+{
+	flash_t flash;
+	mib_t *m = NULL;
+	int len;
+
+	if ( flash_open( &flash, path ) ) {
+		mib_debug( ctx, "Flash open error: %m\n" );
+		return MIB_ERR_IO;
+	}
+	flash_set_alloc( &flash, ctx->alloc, ctx->alloc_arg );
+
+	len = mib_load( ctx, &flash, offset, 0, &m );
+	if ( len >= 0 )
+		memcpy( mib, m, sizeof(mib_t) );
+
+	flash_close( &flash );
+	return len;
+}
+
+#define MIB_FIELD_MIB( member, fmt )					\
+	{ #member, offsetof(mib_t, member),				\
+	  sizeof(((mib_t *)0)->member), fmt, 0 },
+#define MIB_FIELD_WLAN( member, fmt )					\
+	{ #member, offsetof(mib_t, wlan[0].member),			\
+	  sizeof(((mib_wlan_t *)0)->member), fmt, 1 },
+const mib_field_t mib_fields[ MIB_FIELDS_NUM ] = {
+	MIB_MEMBERS( MIB_FIELD_MIB, MIB_FIELD_WLAN )
+};
+
+int mib_field_find( const char *name, unsigned int *wlan )
+{
+	unsigned int i, w = 0, is_wlan = 0;
+
+	/* NUM_WLAN_INTERFACE is below 10, the index is a single digit */
+	if ( !strncmp( name, "wlan", 4 ) ) {
+		w = name[4] - '0';
+		if ( w >= NUM_WLAN_INTERFACE || name[5] != '.' )
+			return -1;
+		name += 6;
+		is_wlan = 1;
+	}
+
+	i = mib_field_slot[ mib_field_hash( name, MIB_FIELD_HASH_SEED ) &
+			    ((1 << MIB_FIELD_HASH_BITS) - 1) ];
+	if ( !i-- || mib_fields[i].wlan != is_wlan ||
+	     strcmp( name, mib_fields[i].name ) )
+		return -1;
+
+	*wlan = w;
+	return i;
+}
+
+unsigned char *mib_field_value( mib_t *mib, unsigned int field,
+				unsigned int wlan )
+{
+	unsigned char *val = (unsigned char *)mib + mib_fields[ field ].offset;
+
+	if ( mib_fields[ field ].wlan )
+		val += wlan * sizeof(mib_wlan_t);
+
+	return val;
+}
+
+int mib_field_present( const mib_t *mib, unsigned int field,
+		       unsigned int wlan )
+{
+	const mib_field_t *f = &mib_fields[ field ];
+
+	if ( !f->wlan )
+		return 1;
+	if ( wlan && wlan >= mib->wlan_num )
+		return 0;
+
+	return f->offset < offsetof(mib_t, wlan[0]) + MIB_WLAN_BASE_SIZE ||
+	       mib_layouts[ mib->layout ].ac;
+}
+
+void mibtbl_want_field( mibtbl_want_t *want, unsigned int field,
+			unsigned int wlan )
+{
+	const mib_field_t *f = &mib_fields[ field ];
+	unsigned int slot;
+
+	for ( slot = 1; slot < MIBTBL_SLOTS; slot++ )
+		if ( mibtbl_desc[ slot ].offset == f->offset &&
+		     mibtbl_desc[ slot ].wlan == f->wlan )
+			want->slots[ wlan ] |= 1ULL << slot;
+}
+
+static int hex_nibble( char c )
+{
+	if ( c >= '0' && c <= '9' )
+		return c - '0';
+	if ( c >= 'a' && c <= 'f' )
+		return c - 'a' + 10;
+	if ( c >= 'A' && c <= 'F' )
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* len bytes as hex digits, with sep between the bytes unless it is 0 */
+static int hex_parse( const char *text, unsigned char *val, uint32_t len,
+		      char sep )
+{
+	uint32_t i;
+	int hi, lo;
+
+	for ( i = 0; i < len; i++ ) {
+		if ( i && sep && *text++ != sep )
+			return MIB_ERR_VALUE;
+		hi = hex_nibble( text[0] );
+		lo = hi < 0 ? -1 : hex_nibble( text[1] );
+		if ( lo < 0 )
+			return MIB_ERR_VALUE;
+		val[i] = hi << 4 | lo;
+		text += 2;
+	}
+
+	return *text ? MIB_ERR_VALUE : 0;
+}
+
+int mib_field_parse( unsigned int field, const char *text,
+		     unsigned char *val )
+{
+	const mib_field_t *f = &mib_fields[ field ];
+	unsigned long n;
+	size_t len;
+	char *end;
+
+	switch ( f->fmt ) {
+	case MIB_FMT_INT:
+		errno = 0;
+		n = strtoul( text, &end, 0 );
+		if ( !*text || *end || errno || n > 0xff )
+			return MIB_ERR_VALUE;
+		*val = n;
+		return 0;
+	case MIB_FMT_MAC:
+		return hex_parse( text, val, f->size,
+				  strlen( text ) > 2 * f->size ? ':' : 0 );
+	case MIB_FMT_HEX:
+		return hex_parse( text, val, f->size, 0 );
+	case MIB_FMT_STR:
+		len = strlen( text );
+		if ( len > f->size )
+			return MIB_ERR_VALUE;
+		memset( val, 0, f->size );
+		memcpy( val, text, len );
+		return 0;
+	}
+
+	return MIB_ERR_VALUE;
+}
+
+/* write the values in *mib back into the TLV table they came from */
+static void mibtbl_from_struct( unsigned char *tbl, uint32_t size,
+				const mib_t *mib )
+{
+	const mibtbl_desc_t *desc;
+	const unsigned char *src;
+	unsigned int type, wlan = 0, wlan_used = 0;
+	uint32_t pos = 0, len;
+	mibtbl_t mibtbl;
+
+	while ( pos + sizeof(mibtbl_t) <= size ) {
+		memcpy( &mibtbl, tbl + pos, sizeof(mibtbl_t) );
+		type = swap16(mibtbl.type);
+		len = swap16(mibtbl.size);
+		pos += sizeof(mibtbl_t);
+
+		/* same interface numbering as mibtbl_parser_feed() */
+		if ( type > MIB_TABLE_LIST ) {
+			if ( wlan_used ) {
+				wlan++;
+				wlan_used = 0;
+			}
+			continue;
+		}
+		if ( !type || len > size - pos )
+			break;
+
+		desc = mibtbl_lookup( type );
+		if ( desc && (!desc->wlan || wlan < NUM_WLAN_INTERFACE) ) {
+			src = (const unsigned char *)mib + desc->offset;
+			if ( desc->wlan ) {
+				src += wlan * sizeof(mib_wlan_t);
+				wlan_used = 1;
+			}
+			memcpy( tbl + pos, src, len < desc->size ? len : desc->size );
+		}
+		pos += len;
+	}
+}
+
+/* a table header between interfaces, see mibtbl_parser_feed() */
+#define MIBTBL_WLAN_TABLE	0xc900
+
+static uint32_t mibtbl_put( unsigned char *out, uint32_t size, uint32_t pos,
+			    unsigned int type, const void *val, uint32_t len )
+{
+	mibtbl_t mibtbl;
+
+	if ( out && pos + sizeof(mibtbl_t) + len <= size ) {
+		mibtbl.type = swap16( type );
+		mibtbl.size = swap16( len );
+		memcpy( out + pos, &mibtbl, sizeof(mibtbl_t) );
+		memcpy( out + pos + sizeof(mibtbl_t), val, len );
+	}
+
+	return pos + sizeof(mibtbl_t) + len;
+}
+
+#define MIBTBL_PUT_MIB( id, member )					\
+	pos = mibtbl_put( out, size, pos, id, &mib->member,		\
+			  sizeof(mib->member) );
+#define MIBTBL_PUT_WLAN( id, member )					\
+	pos = mibtbl_put( out, size, pos, id, &w->member,		\
+			  sizeof(w->member) );
+#define MIBTBL_PUT_NONE( id, member )
+
+int mib_tlv_section( const mib_t *mib, const unsigned char *sig,
+		     unsigned char *out, uint32_t size )
+{
+	const mib_wlan_t *w;
+	mib_hdr_t hdr;
+	uint32_t pos = sizeof(mib_hdr_t), start;
+	unsigned int i, num;
+
+	if ( mib->layout != MIB_LAYOUT_TLV && mib_layouts[ mib->layout ].ac )
+		return MIB_ERR_MISSING;
+
+	MIBTBL_FIELDS( MIBTBL_PUT_MIB, MIBTBL_PUT_NONE )
+
+	num = mib->wlan_num ? mib->wlan_num : 1;
+	for ( i = 0; i < num && i < NUM_WLAN_INTERFACE; i++ ) {
+		w = &mib->wlan[i];
+		start = pos;
+		pos += sizeof(mibtbl_t);
+		MIBTBL_FIELDS( MIBTBL_PUT_NONE, MIBTBL_PUT_WLAN )
+		mibtbl_put( out, size, start, MIBTBL_WLAN_TABLE, NULL, 0 );
+		if ( out && pos <= size ) {
+			hdr.len = swap16( pos - start - sizeof(mibtbl_t) );
+			memcpy( out + start + offsetof(mibtbl_t, size),
+				&hdr.len, sizeof(hdr.len) );
+		}
+	}
+	pos = mibtbl_put( out, size, pos, 0, NULL, 0 );
+
+	/* the checksum byte */
+	pos++;
+	if ( !out )
+		return pos;
+	if ( pos > size || pos - sizeof(mib_hdr_t) > 0xffff )
+		return MIB_ERR_LENGTH;
+
+	memcpy( hdr.sig, sig, MIB_SIG_LEN );
+	hdr.len = swap16( pos - sizeof(mib_hdr_t) );
+	memcpy( out, &hdr, sizeof(mib_hdr_t) );
+	out[ pos - 1 ] = mib_checksum( out + sizeof(mib_hdr_t),
+				       pos - sizeof(mib_hdr_t) - 1 );
+	return pos;
+}
+
+/* the reverse of mib_layout_expand() */
+static void mib_layout_store( const mib_t *mib, unsigned char *data,
+			      int layout )
+{
+	const mib_layout_t *l = &mib_layouts[ layout ];
+	const uint32_t size = l->ac ? sizeof(mib_wlan_t) : MIB_WLAN_BASE_SIZE;
+	unsigned int i;
+
+	memcpy( data, mib, MIB_WLAN_OFFSET );
+	for ( i = 0; i < l->wlan_num; i++ )
+		memcpy( data + MIB_WLAN_OFFSET + i * size, &mib->wlan[i],
+			size );
+}
+
+int mib_patch( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+	       const mib_edit_t *edit, unsigned int n, unsigned char **img,
+	       uint32_t *old_len )
+{
+	mib_hdr_compr_t header;
+	const mib_field_t *f;
+	unsigned char *p, *sect = NULL;
+	mib_t *mib, *check = NULL;
+	uint32_t hlen, data_len, i;
+	int len, compressed, layout = MIB_LAYOUT_TLV, err;
+
+	*img = NULL;
+
+	p = flash_map( fl, offset, sizeof(mib_hdr_compr_t) );
+	if ( !p )
+		return MIB_ERR_IO;
+	memcpy( &header, p, sizeof(header) );
+	compressed = !memcmp( header.sig, MIB_HEADER_COMP_TAG,
+			      MIB_COMPR_TAG_LEN );
+
+	len = mib_load( ctx, fl, offset, 0, &mib );
+	if ( len < 0 )
+		return len;
+
+	if ( compressed ) {
+		hlen = sizeof(mib_hdr_compr_t);
+		*old_len = hlen + swap32(header.len);
+		data_len = sizeof(mib_hdr_t) +
+			   swap16( ((mib_hdr_t *)ctx->dec)->len );
+	} else {
+		hlen = sizeof(mib_hdr_t);
+		*old_len = hlen + len;
+		data_len = *old_len;
+		layout = mib_layout_select( len );
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		err = mib_field_parse( edit[i].field, edit[i].value,
+			mib_field_value( mib, edit[i].field, edit[i].wlan ) );
+		if ( err )
+			return err;
+	}
+
+	/*
+	 * the decoded section or the plain one as it is on flash, with the
+	 * patched values stored back and a fresh checksum
+	 */
+	err = MIB_ERR_NOMEM;
+	sect = (unsigned char *)mib_alloc( ctx, data_len );
+	check = (mib_t *)mib_alloc( ctx, sizeof(mib_t) );
+	if ( !sect || !check )
+		goto out;
+
+	if ( compressed ) {
+		memcpy( sect, ctx->dec, data_len );
+		mibtbl_from_struct( sect + sizeof(mib_hdr_t),
+				    data_len - sizeof(mib_hdr_t), mib );
+	} else {
+		err = MIB_ERR_IO;
+		p = flash_map( fl, offset, data_len );
+		if ( !p )
+			goto out;
+		memcpy( sect, p, data_len );
+		mib_layout_store( mib, sect + hlen, layout );
+	}
+	/* plain sections exactly the size of their layout have no room */
+	if ( compressed || (uint32_t)len > mib_layouts[ layout ].size )
+		sect[ data_len - 1 ] = mib_checksum( sect + sizeof(mib_hdr_t),
+					data_len - sizeof(mib_hdr_t) - 1 );
+
+	/* read the result back: every edit has to be where it is looked for */
+	memset( check, 0, sizeof(mib_t) );
+	if ( compressed )
+		mibtbl_to_struct( ctx, sect + sizeof(mib_hdr_t),
+				  data_len - sizeof(mib_hdr_t),
+				  (unsigned char *)check );
+	else
+		mib_layouts[ layout ].copy( check, sect + hlen );
+	err = MIB_ERR_MISSING;
+	for ( i = 0; i < n; i++ ) {
+		f = &mib_fields[ edit[i].field ];
+		if ( memcmp( mib_field_value( check, edit[i].field,
+					      edit[i].wlan ),
+			     mib_field_value( mib, edit[i].field,
+					      edit[i].wlan ), f->size ) ) {
+			if ( f->wlan )
+				mib_error( ctx, "wlan%u.%s: %s\n", edit[i].wlan,
+					   f->name, mib_strerror( err ) );
+			else
+				mib_error( ctx, "%s: %s\n", f->name,
+					   mib_strerror( err ) );
+			goto out;
+		}
+	}
+
+	if ( compressed ) {
+		err = mib_encode( sect, data_len,
+				  (const char *)header.sig + MIB_COMPR_TAG_LEN,
+				  img, ctx->alloc, ctx->alloc_arg );
+		if ( err < 0 )
+			err = MIB_ERR_GENERIC;
+	} else {
+		err = MIB_ERR_NOMEM;
+		*img = (unsigned char *)mib_alloc( ctx, data_len );
+		if ( !*img )
+			goto out;
+		memcpy( *img, sect, data_len );
+		err = data_len;
+	}
+
+out:
+	mib_free( ctx, check );
+	mib_free( ctx, sect );
+	return err;
+}
+
+int mib_set( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+	     const mib_edit_t *edit, unsigned int n, unsigned int *blocks )
+{
+	unsigned char *p, *img = NULL;
+	uint32_t old_len = 0, img_len, i;
+	int err;
+
+	if ( blocks )
+		*blocks = 0;
+
+	err = mib_patch( ctx, fl, offset, edit, n, &img, &old_len );
+	if ( err < 0 )
+		return err;
+	img_len = err;
+
+	if ( img_len > old_len ) {
+		/* growing is fine as long as it is into unused flash */
+		err = MIB_ERR_IO;
+		p = flash_map( fl, offset + old_len, img_len - old_len );
+		if ( !p )
+			goto out;
+		err = MIB_ERR_LENGTH;
+		for ( i = 0; i < img_len - old_len; i++ )
+			if ( p[i] != 0xff )
+				goto out;
+	} else if ( img_len < old_len ) {
+		err = MIB_ERR_NOMEM;
+		p = (unsigned char *)ctx->alloc( ctx->alloc_arg, img, old_len );
+		if ( !p )
+			goto out;
+		img = p;
+		memset( img + img_len, 0xff, old_len - img_len );
+		img_len = old_len;
+	}
+
+	mib_debug( ctx, "writing 0x%x bytes at 0x%x\n", img_len, offset );
+	err = flash_update( fl, offset, img, img_len, blocks );
+	if ( err < 0 ) {
+		mib_error( ctx, "flash write failed: %m\n" );
+		err = MIB_ERR_IO;
+	}
+
+out:
+	mib_free( ctx, img );
+	return err;
+}
@@ -0,0 +1,398 @@
+#ifndef _MIB_H_
+#define _MIB_H_
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "flash.h"
+#include "lzss.h"
+
+/*
+ * librtkmib: locate, decode and parse MIB sections. Include rtkmib.h
+ * and mibtbl.h before this header. The layout of a plain section is
+ * found from its length, one build reads every board.
+ *
+ * All state lives in a mib_ctx_t, so every thread that loads sections
+ * concurrently needs a context of its own. Errors are returned as
+ * MIB_ERR_* codes, diagnostics only ever go to the log callback.
+ */
+
+/* realloc() style allocator: size 0 frees ptr, NULL ptr allocates */
+typedef void *(*mib_realloc_t)( void *arg, void *ptr, size_t size );
+
+/* printf style diagnostics, every message ends with a newline */
+#define MIB_LOG_ERR		0
+#define MIB_LOG_DEBUG		1
+
+typedef void (*mib_log_t)( void *arg, int level, const char *fmt,
+			   va_list ap );
+
+typedef struct mib_ctx mib_ctx_t;
+
+/* NULL hooks select libc and no logging */
+mib_ctx_t *mib_ctx_new( mib_realloc_t alloc, void *alloc_arg,
+			mib_log_t log, void *log_arg );
+void mib_ctx_free( mib_ctx_t *ctx );
+
+/* highest level passed to the log callback, MIB_LOG_ERR by default */
+void mib_ctx_set_log_level( mib_ctx_t *ctx, int level );
+
+/*
+ * Decode into a caller supplied buffer of cap bytes instead of an
+ * allocated one. Sections that do not fit fail with MIB_ERR_NOMEM.
+ */
+void mib_ctx_set_buffer( mib_ctx_t *ctx, unsigned char *buf, uint32_t cap );
+
+/*
+ * Per stage timings and byte counts. The library fills in header,
+ * read, decode and parse on every load and keeps adding them up; open,
+ * cache, format and write are left to the caller.
+ */
+enum {
+	MIB_STAGE_OPEN,
+	MIB_STAGE_HEADER,	/* locate and check the section header */
+	MIB_STAGE_READ,		/* payload off the flash or input */
+	MIB_STAGE_DECODE,	/* LZSS, bytes produced */
+	MIB_STAGE_PARSE,	/* TLV walk, table bytes consumed */
+	MIB_STAGE_CACHE,
+	MIB_STAGE_FORMAT,
+	MIB_STAGE_WRITE,
+	MIB_STAGES
+};
+
+typedef struct mib_stats {
+	uint64_t ns[ MIB_STAGES ];
+	uint64_t bytes[ MIB_STAGES ];
+} mib_stats_t;
+
+extern const char *const mib_stage_names[ MIB_STAGES ];
+
+static inline uint64_t mib_now_ns( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+const mib_stats_t *mib_ctx_stats( mib_ctx_t *ctx );
+
+/*
+ * Plain H6 sections hold the members of mib_t as they are: the board
+ * data, then a mib_wlan_t per interface, with or without the AC
+ * tables. L( name, wlan_num, ac ) lists every such layout; tables
+ * parsed from COMP sections are MIB_LAYOUT_TLV.
+ */
+#define MIB_LAYOUTS( L )						\
+	L( 1,		1, 0 )						\
+	L( 1_AC,	1, 1 )						\
+	L( 2,		2, 0 )						\
+	L( 2_AC,	2, 1 )
+
+#define MIB_LAYOUT_ENUM( name, num, ac )	MIB_LAYOUT_##name,
+enum {
+	MIB_LAYOUT_TLV,
+	MIB_LAYOUTS( MIB_LAYOUT_ENUM )
+	MIB_LAYOUTS_NUM
+};
+
+typedef struct mib_layout {
+	const char *name;
+	unsigned char wlan_num;
+	unsigned char ac;
+	uint32_t size;		/* section data, 0 for MIB_LAYOUT_TLV */
+	/* fill all of *mib from a plain section, data may alias mib */
+	void (*copy)( mib_t *mib, const unsigned char *data );
+} mib_layout_t;
+
+extern const mib_layout_t mib_layouts[ MIB_LAYOUTS_NUM ];
+
+/*
+ * Layout of a plain section with len bytes of data: the one it fits
+ * exactly, with or without the trailing checksum byte, else the
+ * largest one that fits. -1 if len is below MIB_SIZE_MIN.
+ */
+int mib_layout_select( uint32_t len );
+
+void *mib_alloc( mib_ctx_t *ctx, size_t size );
+void mib_free( mib_ctx_t *ctx, void *ptr );
+
+const char *mib_strerror( int err );
+
+/*
+ * Locate the section at offset. For plain sections the length is
+ * returned and *mib points at the data, for compressed ones
+ * MIB_ERR_COMPRESSED is returned and *size is the payload length.
+ * *mib points into the flash window and stays valid until the next
+ * flash_map() or flash_close().
+ */
+int mib_read( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+	      unsigned char **mib, uint32_t *size );
+
+/*
+ * Read and parse the section at offset. On success the section length
+ * is returned and *mib points into the context, valid until the next
+ * load. Plain sections are copied in through their mib_layout_t.
+ * compare also runs the reference decoder, see mib_decode_ref().
+ */
+int mib_load( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+	      int compare, mib_t **mib );
+
+/* open path, load the section at offset into the caller's *mib */
+int mib_load_file( mib_ctx_t *ctx, const char *path, unsigned int offset,
+		   mib_t *mib );
+
+/*
+ * The settings area: hardware (HS), default (DS) and current (CS)
+ * settings stored back to back. mib_area_load() reads size bytes from
+ * offset in one go and picks up every section in it. HS is parsed
+ * into hs, DS and CS are kept decoded (mib_hdr_t and TLV table) for
+ * mibtbl_next(). len is 0 for sections that were not found.
+ */
+enum {
+	MIB_SECT_HS,
+	MIB_SECT_DS,
+	MIB_SECT_CS,
+	MIB_SECTS
+};
+
+extern const char *const mib_sect_names[ MIB_SECTS ];
+
+typedef struct mib_area_sect {
+	uint32_t offset;	/* of the header on flash */
+	int compressed;
+	uint32_t len;		/* on-flash payload size */
+	uint32_t data_len;	/* decoded section, mib_hdr_t included */
+	unsigned char *data;	/* decoded section, NULL for plain HS */
+} mib_area_sect_t;
+
+typedef struct mib_area {
+	mib_t hs;
+	mib_area_sect_t sect[ MIB_SECTS ];
+} mib_area_t;
+
+/* number of sections found or MIB_ERR_* */
+int mib_area_load( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+		   uint32_t size, mib_area_t *area );
+void mib_area_free( mib_ctx_t *ctx, mib_area_t *area );
+
+/*
+ * Walk the fields of a TLV table, stepping over sub-table headers.
+ * Returns the value of the field at *pos and moves *pos past it, or
+ * NULL once the table ends.
+ */
+const unsigned char *mibtbl_next( const unsigned char *tbl, uint32_t size,
+				  uint32_t *pos, unsigned int *type,
+				  uint32_t *len );
+
+/* hash of the raw section at offset, header and payload as on flash */
+int mib_section_fingerprint( mib_ctx_t *ctx, flash_t *fl,
+			     unsigned int offset, uint64_t *fp );
+
+/* set of TLV fields a caller is waiting for */
+typedef struct mibtbl_want {
+	uint64_t slots[ NUM_WLAN_INTERFACE ];
+} mibtbl_want_t;
+
+void mibtbl_want_id( mibtbl_want_t *want, unsigned int type,
+		     unsigned int wlan );
+/* end of the last wanted field in mib_t */
+uint32_t mibtbl_want_end( const mibtbl_want_t *want );
+
+/*
+ * Read the section at offset from fd, which may be a pipe, decoding
+ * and parsing on the fly and stopping once every wanted field is in
+ * *mib. end is the end of the last wanted member in mib_t; plain
+ * sections are only cut short there if it lies within MIB_SIZE_MIN.
+ * verify reads the whole section instead and checks its checksum,
+ * MIB_ERR_CHECKSUM if it does not add up.
+ */
+int mib_stream_load( mib_ctx_t *ctx, int fd, unsigned int offset,
+		     const mibtbl_want_t *want, uint32_t end, int verify,
+		     mib_t *mib );
+
+/* the same for seekable inputs, read through flash_map() */
+int mib_stream_map( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+		    const mibtbl_want_t *want, uint32_t end, int verify,
+		    mib_t *mib );
+
+/*
+ * What a section's TLV table holds. Every id seen gets an entry in
+ * types[], in order of first appearance; ids past MIBTBL_STATS_TYPES
+ * are only counted in overflow.
+ */
+#define MIBTBL_STATS_TYPES	64
+
+typedef struct mibtbl_type_stats {
+	unsigned short type;
+	unsigned char known;	/* has a place in mib_t */
+	uint32_t count;
+	uint32_t bytes;
+	unsigned short min;	/* field sizes */
+	unsigned short max;
+} mibtbl_type_stats_t;
+
+typedef struct mibtbl_stats {
+	uint32_t tables;	/* sub-table headers */
+	uint32_t fields;
+	uint32_t bytes;		/* value bytes of all fields */
+	uint32_t unknown;	/* fields with ids rtkmib does not know */
+	uint32_t truncated;	/* fields longer than their member */
+	uint32_t overflow;
+	unsigned int ntypes;
+	mibtbl_type_stats_t types[ MIBTBL_STATS_TYPES ];
+} mibtbl_stats_t;
+
+typedef struct mib_analysis {
+	int compressed;
+	uint32_t hdr_len;	/* on-flash header size */
+	uint32_t len;		/* on-flash payload size */
+	unsigned int factor;	/* mib_hdr_compr_t.factor */
+	uint32_t data_len;	/* decoded section, mib_hdr_t included */
+	lzss_analysis_t lzss;	/* compressed sections only */
+	mibtbl_stats_t tbl;	/* compressed sections only */
+} mib_analysis_t;
+
+/*
+ * Decode the section at offset and describe its LZSS stream and TLV
+ * table. Plain sections hold mib_t as it is and only get the sizes.
+ */
+int mib_analyze( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+		 mib_analysis_t *an );
+
+/*
+ * Every member of mib_t and mib_wlan_t by name, see MIB_MEMBERS.
+ * Top level members are named as in mib_t, wlan members are found
+ * as wlanN.member.
+ */
+typedef struct mib_field {
+	const char *name;
+	unsigned short offset;	/* into mib_t, wlan[0] for wlan fields */
+	unsigned short size;
+	unsigned char fmt;	/* MIB_FMT_* */
+	unsigned char wlan;
+} mib_field_t;
+
+#define MIB_FIELD_COUNT( member, fmt )	+ 1
+enum { MIB_FIELDS_NUM = 0 MIB_MEMBERS( MIB_FIELD_COUNT, MIB_FIELD_COUNT ) };
+
+extern const mib_field_t mib_fields[ MIB_FIELDS_NUM ];
+
+/*
+ * mib_field_find() hashes the member name into a table of
+ * 1 << MIB_FIELD_HASH_BITS slots that mibhash_gen fills at build time
+ * with a seed under which no two names collide, so a lookup is one hash
+ * and one compare.
+ */
+#define MIB_FIELD_HASH_BITS	8
+
+/* FNV-1a over a member name, without the wlanN. prefix */
+static inline uint32_t mib_field_hash( const char *name, uint32_t seed )
+{
+	uint32_t h = 2166136261u ^ seed;
+
+	while ( *name ) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+
+	/* the low bits of a product only see the low bits of the seed */
+	return h ^ h >> 16;
+}
+
+/* index into mib_fields[] or -1, *wlan is set for wlan members */
+int mib_field_find( const char *name, unsigned int *wlan );
+
+/* the field's value in *mib */
+unsigned char *mib_field_value( mib_t *mib, unsigned int field,
+				unsigned int wlan );
+
+/*
+ * Whether the section *mib came from carries the field at all: wlan0
+ * always counts, AC tables only in AC layouts.
+ */
+int mib_field_present( const mib_t *mib, unsigned int field,
+		       unsigned int wlan );
+
+/* add the TLV that carries a field, if there is one, to want */
+void mibtbl_want_field( mibtbl_want_t *want, unsigned int field,
+			unsigned int wlan );
+
+/*
+ * Parse text as the field is printed (decimal, xx:xx:xx:xx:xx:xx, hex
+ * digits for the whole array or a string) into val. MIB_ERR_VALUE if
+ * it does not fit.
+ */
+int mib_field_parse( unsigned int field, const char *text,
+		     unsigned char *val );
+
+/* byte sum of data, modulo 256, a word at a time */
+unsigned char mib_sum( const unsigned char *data, uint32_t len );
+
+/* lower case hex digit pairs by byte value, no terminator */
+extern const char mib_hex[ 256 ][ 2 ];
+
+/*
+ * Realtek section checksum: the last byte of the data makes the byte
+ * sum of the whole data zero.
+ */
+static inline unsigned char mib_checksum( const unsigned char *data,
+					  uint32_t len )
+{
+	return -mib_sum( data, len );
+}
+
+/*
+ * Check the checksum of the section at offset without parsing it,
+ * COMP sections are only expanded. Returns the number of bytes summed,
+ * 0 for plain sections too short to carry a checksum, or MIB_ERR_*;
+ * MIB_ERR_CHECKSUM if it does not add up. mib_load() runs the same
+ * check, the streaming path only when asked to, see mib_stream_load().
+ */
+int mib_verify( mib_ctx_t *ctx, flash_t *fl, unsigned int offset );
+
+typedef struct mib_edit {
+	unsigned int field;	/* index into mib_fields[] */
+	unsigned int wlan;
+	const char *value;	/* see mib_field_parse() */
+} mib_edit_t;
+
+/*
+ * Apply n edits to the section at offset, fl opened by flash_open_rw().
+ * The section is parsed, patched and written back the way it was
+ * stored: values go back into the TLV table or the plain layout, the
+ * checksum byte is recomputed and COMP sections are compressed again
+ * with a new header. Only erase blocks that change are written, see
+ * flash_update(). A section that grows may only run into erased
+ * (0xff) flash, one that shrinks leaves its old tail erased.
+ *
+ * Returns the number of blocks written, *blocks the number compared,
+ * or MIB_ERR_*: MIB_ERR_MISSING if the section has nowhere to keep one
+ * of the fields.
+ */
+int mib_set( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+	     const mib_edit_t *edit, unsigned int n, unsigned int *blocks );
+
+/*
+ * Build a decoded COMP section from *mib: a header with sig and the
+ * TLV table of every field that has an id, with the checksum byte.
+ * With out NULL only the length is returned, else the length written
+ * or MIB_ERR_LENGTH if size is too small. MIB_ERR_MISSING for AC
+ * layouts, the AC tables have no TLV ids and would be lost.
+ */
+int mib_tlv_section( const mib_t *mib, const unsigned char *sig,
+		     unsigned char *out, uint32_t size );
+
+/*
+ * What mib_set() writes, without writing it: the patched section with
+ * its header in *img, to be given back with mib_free(). Returns its
+ * length or MIB_ERR_*, *old_len is the on-flash size of the section it
+ * replaces.
+ */
+int mib_patch( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+	       const mib_edit_t *edit, unsigned int n, unsigned char **img,
+	       uint32_t *old_len );
+
+#endif /* _MIB_H_ */
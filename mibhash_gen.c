@@ -0,0 +1,55 @@
+/*
+ * Build time helper: finds a seed for mib_field_hash() that puts every
+ * MIB_MEMBERS name into a slot of its own and writes the slot table as
+ * mibhash.h for mib.c.
+ */
+#include "rtkmib.h"
+#include "mibtbl.h"
+#include "lzss.h"
+#include "flash.h"
+#include "mib.h"
+
+#define NAME( member, fmt )	#member,
+static const char *names[] = {
+	MIB_MEMBERS( NAME, NAME )
+};
+
+#define NAMES_NUM	(sizeof(names) / sizeof(names[0]))
+#define SLOTS		(1 << MIB_FIELD_HASH_BITS)
+
+typedef char names_fit_slots[ NAMES_NUM < SLOTS && SLOTS <= 256 ? 1 : -1 ];
+
+int main( void )
+{
+	unsigned char slot[ SLOTS ];
+	uint32_t seed, h;
+	unsigned int i;
+
+	for ( seed = 0; seed < 0x1000000; seed++ ) {
+		memset( slot, 0, sizeof(slot) );
+		for ( i = 0; i < NAMES_NUM; i++ ) {
+			h = mib_field_hash( names[i], seed ) & (SLOTS - 1);
+			if ( slot[h] )
+				break;
+			slot[h] = i + 1;
+		}
+		if ( i == NAMES_NUM )
+			break;
+	}
+	if ( i != NAMES_NUM ) {
+		fprintf( stderr, "no perfect hash for %u names in %u slots\n",
+			 (unsigned int)NAMES_NUM, SLOTS );
+		return 1;
+	}
+
+	printf( "/* generated by mibhash_gen from MIB_MEMBERS, do not edit */\n"
+		"#define MIB_FIELD_HASH_SEED\t0x%xu\n\n"
+		"/* index into mib_fields[] plus one, 0 for empty slots */\n"
+		"static const unsigned char mib_field_slot[ %u ] = {",
+		seed, SLOTS );
+	for ( i = 0; i < SLOTS; i++ )
+		printf( "%s%3u,", i % 12 ? " " : "\n\t", slot[i] );
+	printf( "\n};\n" );
+
+	return 0;
+}
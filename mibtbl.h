@@ -61,3 +61,148 @@ typedef struct mibtbl {
 	unsigned short type;
 	unsigned short size;
 } __PACK__ mibtbl_t;
+
+/*
+ * HW setting TLV ids and the mib_t members they are stored in.
+ * X( id, member ) for top level fields,
+ * W( id, member ) for fields repeated in every wlan[] interface.
+ */
+#define MIBTBL_FIELDS( X, W )						\
+	X( MIB_HW_BOARD_VER,		board_ver )			\
+	X( MIB_HW_NIC0_ADDR,		nic0_addr )			\
+	X( MIB_HW_NIC1_ADDR,		nic1_addr )			\
+	W( MIB_HW_WLAN_ADDR,		macAddr )			\
+	W( MIB_HW_REG_DOMAIN,		regDomain )			\
+	W( MIB_HW_RF_TYPE,		rfType )			\
+	W( MIB_HW_LED_TYPE,		ledType )			\
+	W( MIB_HW_WSC_PIN,		wscPin )			\
+	W( MIB_HW_11N_XCAP,		xCap )				\
+	W( MIB_HW_WLAN_ADDR1,		macAddr1 )			\
+	W( MIB_HW_WLAN_ADDR2,		macAddr2 )			\
+	W( MIB_HW_WLAN_ADDR3,		macAddr3 )			\
+	W( MIB_HW_WLAN_ADDR4,		macAddr4 )			\
+	W( MIB_HW_WLAN_ADDR5,		macAddr5 )			\
+	W( MIB_HW_WLAN_ADDR6,		macAddr6 )			\
+	W( MIB_HW_WLAN_ADDR7,		macAddr7 )			\
+	W( MIB_HW_11N_TSSI1,		TSSI1 )				\
+	W( MIB_HW_11N_TSSI2,		TSSI2 )				\
+	W( MIB_HW_11N_THER,		Ther )				\
+	W( MIB_HW_11N_TRSWITCH,		trswitch )			\
+	W( MIB_HW_11N_TRSWPAPE_C9,	trswpape_c9 )			\
+	W( MIB_HW_11N_TRSWPAPE_CC,	trswpape_cc )			\
+	W( MIB_HW_11N_TARGET_PWR,	target_pwr )			\
+	W( MIB_HW_11N_RESERVED5,	Reserved5 )			\
+	W( MIB_HW_11N_RESERVED6,	Reserved6 )			\
+	W( MIB_HW_11N_RESERVED7,	Reserved7 )			\
+	W( MIB_HW_11N_RESERVED8,	Reserved8 )			\
+	W( MIB_HW_TX_POWER_CCK_A,	pwrlevelCCK_A )			\
+	W( MIB_HW_TX_POWER_CCK_B,	pwrlevelCCK_B )			\
+	W( MIB_HW_TX_POWER_HT40_1S_A,	pwrlevelHT40_1S_A )		\
+	W( MIB_HW_TX_POWER_HT40_1S_B,	pwrlevelHT40_1S_B )		\
+	W( MIB_HW_TX_POWER_DIFF_HT40_2S, pwrdiffHT40_2S )		\
+	W( MIB_HW_TX_POWER_DIFF_HT20,	pwrdiffHT20 )			\
+	W( MIB_HW_TX_POWER_DIFF_OFDM,	pwrdiffOFDM )			\
+	W( MIB_HW_11N_RESERVED9,	Reserved9 )			\
+	W( MIB_HW_11N_RESERVED10,	Reserved10 )			\
+	W( MIB_HW_TX_POWER_5G_HT40_1S_A, pwrlevel5GHT40_1S_A )		\
+	W( MIB_HW_TX_POWER_5G_HT40_1S_B, pwrlevel5GHT40_1S_B )		\
+	W( MIB_HW_TX_POWER_DIFF_5G_HT40_2S, pwrdiff5GHT40_2S )		\
+	W( MIB_HW_TX_POWER_DIFF_5G_HT20, pwrdiff5GHT20 )		\
+	W( MIB_HW_TX_POWER_DIFF_5G_OFDM, pwrdiff5GOFDM )
+
+/*
+ * Every member of mib_t (X) and mib_wlan_t (W) with the way its value
+ * is printed, used to look fields up by name.
+ */
+#define MIB_FMT_INT			0
+#define MIB_FMT_MAC			1
+#define MIB_FMT_HEX			2
+#define MIB_FMT_STR			3
+
+#define MIB_MEMBERS( X, W )						\
+	X( board_ver,			MIB_FMT_INT )			\
+	X( nic0_addr,			MIB_FMT_MAC )			\
+	X( nic1_addr,			MIB_FMT_MAC )			\
+	W( macAddr,			MIB_FMT_MAC )			\
+	W( macAddr1,			MIB_FMT_MAC )			\
+	W( macAddr2,			MIB_FMT_MAC )			\
+	W( macAddr3,			MIB_FMT_MAC )			\
+	W( macAddr4,			MIB_FMT_MAC )			\
+	W( macAddr5,			MIB_FMT_MAC )			\
+	W( macAddr6,			MIB_FMT_MAC )			\
+	W( macAddr7,			MIB_FMT_MAC )			\
+	W( pwrlevelCCK_A,		MIB_FMT_HEX )			\
+	W( pwrlevelCCK_B,		MIB_FMT_HEX )			\
+	W( pwrlevelHT40_1S_A,		MIB_FMT_HEX )			\
+	W( pwrlevelHT40_1S_B,		MIB_FMT_HEX )			\
+	W( pwrdiffHT40_2S,		MIB_FMT_HEX )			\
+	W( pwrdiffHT20,			MIB_FMT_HEX )			\
+	W( pwrdiffOFDM,			MIB_FMT_HEX )			\
+	W( regDomain,			MIB_FMT_INT )			\
+	W( rfType,			MIB_FMT_INT )			\
+	W( ledType,			MIB_FMT_INT )			\
+	W( xCap,			MIB_FMT_INT )			\
+	W( TSSI1,			MIB_FMT_INT )			\
+	W( TSSI2,			MIB_FMT_INT )			\
+	W( Ther,			MIB_FMT_INT )			\
+	W( trswitch,			MIB_FMT_INT )			\
+	W( trswpape_c9,			MIB_FMT_INT )			\
+	W( trswpape_cc,			MIB_FMT_INT )			\
+	W( target_pwr,			MIB_FMT_INT )			\
+	W( Reserved5,			MIB_FMT_INT )			\
+	W( Reserved6,			MIB_FMT_INT )			\
+	W( Reserved7,			MIB_FMT_INT )			\
+	W( Reserved8,			MIB_FMT_INT )			\
+	W( Reserved9,			MIB_FMT_INT )			\
+	W( Reserved10,			MIB_FMT_INT )			\
+	W( pwrlevel5GHT40_1S_A,		MIB_FMT_HEX )			\
+	W( pwrlevel5GHT40_1S_B,		MIB_FMT_HEX )			\
+	W( pwrdiff5GHT40_2S,		MIB_FMT_HEX )			\
+	W( pwrdiff5GHT20,		MIB_FMT_HEX )			\
+	W( pwrdiff5GOFDM,		MIB_FMT_HEX )			\
+	W( wscPin,			MIB_FMT_STR )			\
+	MIB_MEMBERS_AC( W )
+
+/* present on AC boards only, see MIB_WLAN_BASE_SIZE */
+#define MIB_MEMBERS_AC( W )						\
+	W( pwrdiff_20BW1S_OFDM1T_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_40BW2S_20BW2S_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_OFDM2T_CCK2T_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_40BW3S_20BW3S_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_4OFDM3T_CCK3T_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_40BW4S_20BW4S_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_OFDM4T_CCK4T_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_20BW1S_OFDM1T_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_40BW2S_20BW2S_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_40BW3S_20BW3S_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_40BW4S_20BW4S_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_RSVD_OFDM4T_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_80BW1S_160BW1S_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_80BW2S_160BW2S_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_80BW3S_160BW3S_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_80BW4S_160BW4S_A,	MIB_FMT_HEX )			\
+	W( pwrdiff_20BW1S_OFDM1T_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_40BW2S_20BW2S_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_OFDM2T_CCK2T_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_40BW3S_20BW3S_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_OFDM3T_CCK3T_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_40BW4S_20BW4S_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_OFDM4T_CCK4T_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_20BW1S_OFDM1T_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_40BW2S_20BW2S_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_40BW3S_20BW3S_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_40BW4S_20BW4S_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_RSVD_OFDM4T_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_80BW1S_160BW1S_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_80BW2S_160BW2S_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_80BW3S_160BW3S_B,	MIB_FMT_HEX )			\
+	W( pwrdiff_5G_80BW4S_160BW4S_B,	MIB_FMT_HEX )
+
+/* highest id in MIBTBL_FIELDS */
+#define MIB_HW_ID_MAX			MIB_HW_TX_POWER_DIFF_5G_OFDM
+
+typedef struct mibtbl_desc {
+	unsigned short offset;	/* into mib_t, wlan[0] for wlan fields */
+	unsigned short size;
+	unsigned char wlan;	/* repeated per wlan interface */
+} mibtbl_desc_t;
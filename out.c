@@ -0,0 +1,165 @@
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "rtkmib.h"
+#include "mibtbl.h"
+#include "mib.h"
+#include "out.h"
+
+void mib_out_init( mib_out_t *o, FILE *fp )
+{
+	o->fp = fp;
+	o->n = 0;
+	o->len[0] = 0;
+}
+
+static int mib_out_writev( int fd, struct iovec *iov, int n )
+{
+	ssize_t w;
+
+	while ( n > 0 ) {
+		w = writev( fd, iov, n );
+		if ( w < 0 && errno == EINTR )
+			continue;
+		if ( w < 0 )
+			return -1;
+
+		for ( ; n > 0 && (size_t)w >= iov->iov_len; iov++, n-- )
+			w -= iov->iov_len;
+		if ( n > 0 ) {
+			iov->iov_base = (char *)iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+
+	return 0;
+}
+
+int mib_out_flush( mib_out_t *o )
+{
+	struct iovec iov[ MIB_OUT_CHUNKS ];
+	unsigned int i, n = o->n + 1;
+	int fd, err = 0;
+
+	fd = fileno( o->fp );
+	if ( fd >= 0 ) {
+		/* anything the caller printed through stdio goes first */
+		fflush( o->fp );
+		for ( i = 0; i < n; i++ ) {
+			iov[i].iov_base = o->buf[i];
+			iov[i].iov_len = o->len[i];
+		}
+		err = mib_out_writev( fd, iov, n );
+	} else {
+		for ( i = 0; i < n; i++ )
+			if ( fwrite( o->buf[i], 1, o->len[i], o->fp ) !=
+			     o->len[i] )
+				err = -1;
+	}
+
+	o->n = 0;
+	o->len[0] = 0;
+	return err;
+}
+
+/* room for want bytes in one piece, want is at most MIB_OUT_CHUNK */
+static char *mib_out_room( mib_out_t *o, size_t want )
+{
+	if ( o->len[ o->n ] + want > MIB_OUT_CHUNK ) {
+		if ( o->n + 1 == MIB_OUT_CHUNKS )
+			mib_out_flush( o );
+		else
+			o->len[ ++o->n ] = 0;
+	}
+
+	return o->buf[ o->n ] + o->len[ o->n ];
+}
+
+void mib_out_mem( mib_out_t *o, const void *p, size_t len )
+{
+	const char *s = (const char *)p;
+	size_t n;
+
+	while ( len ) {
+		n = MIB_OUT_CHUNK - o->len[ o->n ];
+		if ( !n )
+			n = len < MIB_OUT_CHUNK ? len : MIB_OUT_CHUNK;
+		else if ( n > len )
+			n = len;
+		memcpy( mib_out_room( o, n ), s, n );
+		o->len[ o->n ] += n;
+		s += n;
+		len -= n;
+	}
+}
+
+void mib_out_str( mib_out_t *o, const char *s )
+{
+	mib_out_mem( o, s, strlen( s ) );
+}
+
+void mib_out_char( mib_out_t *o, char c )
+{
+	*mib_out_room( o, 1 ) = c;
+	o->len[ o->n ]++;
+}
+
+void mib_out_uint( mib_out_t *o, unsigned long val )
+{
+	char tmp[ 3 * sizeof(val) ];
+	char *p = tmp + sizeof(tmp);
+
+	do {
+		*--p = '0' + val % 10;
+		val /= 10;
+	} while ( val );
+
+	mib_out_mem( o, p, tmp + sizeof(tmp) - p );
+}
+
+void mib_out_hex( mib_out_t *o, const unsigned char *p, size_t len )
+{
+	size_t n, i;
+	char *d;
+
+	while ( len ) {
+		n = len < MIB_OUT_CHUNK / 2 ? len : MIB_OUT_CHUNK / 2;
+		d = mib_out_room( o, 2 * n );
+		for ( i = 0; i < n; i++, d += 2 )
+			memcpy( d, mib_hex[ p[i] ], 2 );
+		o->len[ o->n ] += 2 * n;
+		p += n;
+		len -= n;
+	}
+}
+
+void mib_out_mac( mib_out_t *o, const unsigned char *mac )
+{
+	char *d = mib_out_room( o, 17 );
+	int i;
+
+	for ( i = 0; i < 6; i++, d += 3 ) {
+		memcpy( d, mib_hex[ mac[i] ], 2 );
+		if ( i < 5 )
+			d[2] = ':';
+	}
+	o->len[ o->n ] += 17;
+}
+
+void mib_out_printf( mib_out_t *o, const char *fmt, ... )
+{
+	char tmp[ 256 ];
+	va_list ap;
+	int n;
+
+	va_start( ap, fmt );
+	n = vsnprintf( tmp, sizeof(tmp), fmt, ap );
+	va_end( ap );
+
+	if ( n > 0 )
+		mib_out_mem( o, tmp, (size_t)n < sizeof(tmp) ?
+				     (size_t)n : sizeof(tmp) - 1 );
+}
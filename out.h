@@ -0,0 +1,49 @@
+#ifndef _OUT_H_
+#define _OUT_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Text output buffer for the dumps. Everything is formatted into a few
+ * fixed chunks, hex through a table of two character pairs, and
+ * mib_out_flush() hands all filled chunks to writev() at once, or to
+ * fwrite() for streams without a descriptor such as open_memstream().
+ * A full buffer is flushed on its own. The static arena build keeps
+ * it small, it would otherwise outweigh the arena.
+ */
+#define MIB_OUT_CHUNK		4096
+#ifdef MIB_STATIC_ARENA
+#define MIB_OUT_CHUNKS		2
+#else
+#define MIB_OUT_CHUNKS		8
+#endif
+
+typedef struct mib_out {
+	FILE *fp;
+	unsigned int n;				/* chunk being filled */
+	size_t len[ MIB_OUT_CHUNKS ];
+	char buf[ MIB_OUT_CHUNKS ][ MIB_OUT_CHUNK ];
+} mib_out_t;
+
+void mib_out_init( mib_out_t *o, FILE *fp );
+
+/* write out what is buffered, -1 on write errors */
+int mib_out_flush( mib_out_t *o );
+
+void mib_out_mem( mib_out_t *o, const void *p, size_t len );
+void mib_out_str( mib_out_t *o, const char *s );
+void mib_out_char( mib_out_t *o, char c );
+void mib_out_uint( mib_out_t *o, unsigned long val );
+
+/* lower case hex, two digits per byte */
+void mib_out_hex( mib_out_t *o, const unsigned char *p, size_t len );
+
+/* xx:xx:xx:xx:xx:xx */
+void mib_out_mac( mib_out_t *o, const unsigned char *mac );
+
+/* for the rare cases the helpers above do not cover */
+void mib_out_printf( mib_out_t *o, const char *fmt, ... )
+	__attribute__((format(printf, 2, 3)));
+
+#endif /* _OUT_H_ */
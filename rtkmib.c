@@ -1,20 +1,76 @@
+#define _GNU_SOURCE
 #include <getopt.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <signal.h>
+#include <libgen.h>
 
 #include "rtkmib.h"
 #include "mibtbl.h"
+#include "lzss.h"
+#include "flash.h"
+#include "scan.h"
+#include "cache.h"
+#include "shm.h"
+#include "mib.h"
+#include "arena.h"
+#include "out.h"
+#include "slot.h"
+#include "flashsim.h"
+#include "sanity.h"
 
 #define NAME		"rtkmib"
 #define VERSION		"0.0.4"
 
 
 uint8_t verbose = 0;
-static const char *opt_string = ":g:i:O:o:hv";
+
+#ifdef MIB_STATIC_ARENA
+/* every buffer of a single image query comes from here */
+static unsigned char arena_buf[ MIB_ARENA_SIZE ]
+	__attribute__((aligned(MIB_ARENA_ALIGN)));
+static mib_arena_t arena;
+static char stdout_buf[ BUFSIZ ];
+#define CLI_ALLOC	mib_arena_realloc, &arena
+#else
+#define CLI_ALLOC	NULL, NULL
+#endif
+
+/* stdout of the CLI, only ever one user per run */
+static mib_out_t cli_out;
+static const char *opt_string = ":g:q:f:i:O:o:b:B:j:d:S:w:F:L:APCVKceashtv";
 static struct option long_options[] = {
 	{ "get", required_argument, NULL, 'g' },
+	{ "query", required_argument, NULL, 'q' },
+	{ "format", required_argument, NULL, 'f' },
 	{ "input", required_argument, NULL, 'i' },
 	{ "output", required_argument, NULL, 'O' },
 	{ "offset", required_argument, NULL, 'o' },
+	{ "slots", required_argument, NULL, 'b' },
+	{ "cache", no_argument, NULL, 'C' },
+	{ "compare", no_argument, NULL, 'c' },
+	{ "encode", no_argument, NULL, 'e' },
+	{ "batch", required_argument, NULL, 'B' },
+	{ "jobs", required_argument, NULL, 'j' },
+	{ "scan", no_argument, NULL, 's' },
+	{ "analyze", no_argument, NULL, 'a' },
+	{ "verify", no_argument, NULL, 'V' },
+	{ "check", no_argument, NULL, 'K' },
+	{ "limits", required_argument, NULL, 'L' },
+	{ "sections", no_argument, NULL, 'A' },
+	{ "daemon", required_argument, NULL, 'd' },
+	{ "socket", required_argument, NULL, 'S' },
+	{ "publish", no_argument, NULL, 'P' },
+	{ "stats", no_argument, NULL, 't' },
+	{ "set", required_argument, NULL, 'w' },
+	{ "flash-sim", required_argument, NULL, 'F' },
 	{ "help", no_argument, NULL, 'h' },
 	{ "verbose", no_argument, NULL, 'v' },
 	{ 0, 0, 0, 0 },
@@ -27,10 +83,80 @@ void usage ( char *pname ) {
 		"   Options:\n",
 		"   -g, --get              get a part of MIB information:\n",
 		"                          ver, macs, mac0, mac1, wmac0, wcal\n",
+		"                          or a single field by -q name\n",
 		"                          default: ver\n",
-		"   -i, --input            input file name\n",
+		"   -q, --query            get a comma separated list of fields\n",
+		"                          by name (board_ver, nic0_addr,\n",
+		"                          wlan0.macAddr, ...) or all of them\n",
+		"   -f, --format           query output format: sh (KEY=value,\n",
+		"                          default) or json\n",
+		"   -i, --input            input file name, - for stdin\n",
 		"   -O, --output           output file name\n",
 		"   -o, --offset           MIB data start offset (bytes)\n",
+		"   -b, --slots            SIZE: keep two copies of the section\n",
+		"                          at -o and -o + SIZE and read the\n",
+		"                          newest intact one; -w then commits\n",
+		"                          to the other; -o and SIZE must be\n",
+		"                          erase block aligned (64 KiB if unknown)\n",
+		"   -C, --cache            keep the decoded MIB in " MIB_CACHE_DIR "\n",
+		"                          (or " MIB_CACHE_DIR_FALLBACK ") and reuse it while the\n",
+		"                          section on flash is unchanged\n",
+		"   -c, --compare          decode with the reference decoder too\n",
+		"                          and fail if the outputs differ\n",
+		"   -e, --encode           write the MIB section as a COMP image\n",
+		"                          to the output file (default: stdout)\n",
+		"   -B, --batch            decode every image in a directory or\n",
+		"                          listed in a file (one per line, - for\n",
+		"                          stdin); output lines are tagged with\n",
+		"                          the image name and kept in list order;\n",
+		"                          fails if any image does, whatever the\n",
+		"                          mode\n",
+		"   -j, --jobs             batch worker threads (default: CPUs)\n",
+		"   -s, --scan             search the whole input for MIB\n",
+		"                          sections and list their offsets\n",
+		"   -a, --analyze          describe the section: LZSS literal and\n",
+		"                          match counts, match length and offset\n",
+		"                          histograms, compression ratio and the\n",
+		"                          TLV ids found, as KEY=value or with\n",
+		"                          -f json\n",
+		"   -V, --verify           only check the section checksum and\n",
+		"                          print ok, no checksum or the error;\n",
+		"                          with -B for every image, with -g or\n",
+		"                          -q check it before the query\n",
+		"   -K, --check            look for blank or zeroed calibration\n",
+		"                          tables, values out of bounds and\n",
+		"                          bad MAC addresses, print them or ok\n",
+		"   -L, --limits           bounds for -K: ther=MIN-MAX,\n",
+		"                          xcap=MIN-MAX, tssi=MIN-MAX, pwr=MAX,\n",
+		"                          diffzero=1 (also flag zero pwrdiff)\n",
+		"   -A, --sections         read the hardware, default and current\n",
+		"                          settings sections in one pass and list\n",
+		"                          them; -g and -q answer from HS, and -q\n",
+		"                          also takes raw TLVs as hs.<id>[.<n>],\n",
+		"                          ds.<id>[.<n>] or cs.all\n",
+		"   -d, --daemon           decode once and answer queries on\n",
+		"                          the given Unix socket, one request\n",
+		"                          per line: a -g name or a -q list,\n",
+		"                          optionally prefixed with \"json \";\n",
+		"                          answers end with an empty line\n",
+		"   -S, --socket           ask a running daemon instead of\n",
+		"                          reading the flash\n",
+		"   -P, --publish          copy the decoded MIB to the shared\n",
+		"                          memory segment " MIB_SHM_NAME ", see shm.h;\n",
+		"                          with -d on every reload\n",
+		"   -t, --stats            report per stage times (ns), byte\n",
+		"                          counts and allocations on stderr,\n",
+		"                          as KEY=value or with -f json\n",
+		"   -w, --set              NAME=VALUE: change a field in the\n",
+		"                          section at -o on the input device,\n",
+		"                          VALUE as -g NAME prints it; may be\n",
+		"                          repeated, only the erase blocks\n",
+		"                          that change are rewritten\n",
+		"   -F, --flash-sim        treat the input file as NOR flash:\n",
+		"                          erase=SIZE,page=SIZE (0x10000, 0x100,\n",
+		"                          pages up to 0x1000) and tread=,\n",
+		"                          tprog=,terase= latencies\n",
+		"                          in us; -t adds the operation counts\n",
 		"   -h, --help             print this help message\n",
 		"   -v, --verbose          see what's going on under the cap\n",
 		"\n",
@@ -59,509 +185,250 @@ static void printv( const char *format, ... )
 	}
 }
 
-inline int is_big_endian( void )
+/* library diagnostics: errors always, the rest with -v */
+static void cli_log( void *arg, int level, const char *fmt, va_list ap )
+{
+	vprintf( fmt, ap );
+}
+
+static mib_ctx_t *cli_ctx( mib_realloc_t alloc, void *arg )
 {
-	union {
-		uint32_t i;
-		char c[4];
-	} e = { 0x01000000 };
+	mib_ctx_t *ctx = mib_ctx_new( alloc, arg, cli_log, NULL );
 
-	return e.c[0];
+	if ( ctx && verbose )
+		mib_ctx_set_log_level( ctx, MIB_LOG_DEBUG );
+
+	return ctx;
 }
 
-inline uint16_t swap16( uint16_t x )
+/*
+ * --stats: counts every allocation that goes through the library hooks
+ * and passes it on. Each block carries its size in front of it.
+ */
+#define CLI_HEAP_HDR	16
+
+typedef struct cli_heap {
+	mib_realloc_t next;	/* NULL for libc */
+	void *next_arg;
+	unsigned long allocs;
+	unsigned long reallocs;
+	unsigned long frees;
+	size_t cur;
+	size_t peak;
+} cli_heap_t;
+
+static void *cli_heap_realloc( void *arg, void *ptr, size_t size )
 {
-	return is_big_endian()? x : ((x >> 8) & 0xff) | (x << 8);
+	cli_heap_t *h = (cli_heap_t *)arg;
+	unsigned char *p = ptr ? (unsigned char *)ptr - CLI_HEAP_HDR : NULL;
+	size_t old = p ? *(size_t *)p : 0;
+
+	if ( !size ) {
+		if ( !p )
+			return NULL;
+		h->frees++;
+		h->cur -= old;
+		if ( h->next )
+			h->next( h->next_arg, p, 0 );
+		else
+			free( p );
+		return NULL;
+	}
+
+	if ( h->next )
+		p = (unsigned char *)h->next( h->next_arg, p,
+					      size + CLI_HEAP_HDR );
+	else
+		p = (unsigned char *)realloc( p, size + CLI_HEAP_HDR );
+	if ( !p )
+		return NULL;
+
+	if ( ptr )
+		h->reallocs++;
+	else
+		h->allocs++;
+	h->cur += size - old;
+	if ( h->cur > h->peak )
+		h->peak = h->cur;
+	*(size_t *)p = size;
+
+	return p + CLI_HEAP_HDR;
 }
 
-inline uint32_t swap32( uint32_t x )
+static void stats_put( FILE *fp, int json, const char *key,
+		       const char *suffix, unsigned long long val )
 {
-	return is_big_endian()? x :
-				(x >> 24) |
-				((x << 8) & 0x00ff0000) |
-				((x >> 8) & 0x0000ff00) |
-				(x << 24);
+	if ( json )
+		fprintf( fp, ", \"%s%s\": %llu", key, suffix, val );
+	else
+		fprintf( fp, "%s%s=%llu\n", key, suffix, val );
 }
 
-static void print_hex( unsigned char *buf, uint32_t size )
+/* path is how the MIB was obtained: stream, flash or cache */
+static void print_stats( FILE *fp, const mib_stats_t *st,
+			 const cli_heap_t *h, const flash_sim_t *sim,
+			 const char *path, uint64_t total, int json )
 {
-	if ( !buf ) {
-		printf( "Invalid buffer pointer!\n" );
-		return;
+	int i;
+
+	fprintf( fp, json ? "{ \"path\": \"%s\"" : "path=%s\n", path );
+	for ( i = 0; i < MIB_STAGES; i++ ) {
+		stats_put( fp, json, mib_stage_names[i], "_ns", st->ns[i] );
+		stats_put( fp, json, mib_stage_names[i], "_bytes",
+			   st->bytes[i] );
 	}
+	stats_put( fp, json, "total", "_ns", total );
+	stats_put( fp, json, "allocs", "", h->allocs );
+	stats_put( fp, json, "reallocs", "", h->reallocs );
+	stats_put( fp, json, "frees", "", h->frees );
+	stats_put( fp, json, "heap_peak", "", h->peak );
+	if ( sim ) {
+		stats_put( fp, json, "sim_reads", "", sim->reads );
+		stats_put( fp, json, "sim_read", "_bytes", sim->read_bytes );
+		stats_put( fp, json, "sim_programs", "", sim->programs );
+		stats_put( fp, json, "sim_erases", "", sim->erases );
+		stats_put( fp, json, "sim_busy", "_us", sim->busy_us );
+	}
+	if ( json )
+		fprintf( fp, " }\n" );
+}
 
-	uint32_t pos = 0;
-	uint32_t lines = 0;
+/* issues kept for printing, the rest are only counted */
+#define SANITY_SHOW		64
 
-	while ( pos < size ) {
-		printf(" %02x", buf[pos]);
-		pos++;
-		if ( lines == 31 ) {
-			printf("\n");
-			lines = 0;
-			continue;
-		}
-		if ( lines == 7 || lines == 15 || lines == 23 )
-			printf("  ");
-		lines++;
+/* one line per issue, or ok; returns the number of issues */
+static unsigned int sanity_print( mib_out_t *o, const mib_t *mib,
+				  const mib_limits_t *lim )
+{
+	mib_issue_t issues[ SANITY_SHOW ];
+	const mib_field_t *f;
+	unsigned int i, n;
+
+	n = mib_sanity( mib, lim, issues, SANITY_SHOW );
+	if ( !n )
+		mib_out_str( o, "ok\n" );
+
+	for ( i = 0; i < n && i < SANITY_SHOW; i++ ) {
+		f = &mib_fields[ issues[i].field ];
+		if ( f->wlan )
+			mib_out_printf( o, "wlan%u.", issues[i].wlan );
+		mib_out_str( o, f->name );
+		mib_out_str( o, ": " );
+		mib_out_str( o, mib_issue_str( issues[i].kind ) );
+		if ( issues[i].kind == MIB_ISSUE_RANGE )
+			mib_out_printf( o, " (0x%02x)", issues[i].value );
+		mib_out_char( o, '\n' );
 	}
-	printf("\n");
+	if ( n > SANITY_SHOW )
+		mib_out_printf( o, "%u more\n", n - SANITY_SHOW );
+
+	return n;
 }
 
-static void print_mac( unsigned char *buf )
+static void print_mac( mib_out_t *o, const unsigned char *buf )
 {
 	if ( !buf )
 		return;
 
-	printf( "%02x:%02x:%02x:%02x:%02x:%02x",
-			buf[0], buf[1], buf[2],
-			buf[3], buf[4], buf[5] );
+	mib_out_mac( o, buf );
 }
 
-static int flash_read( char *mtd, int offset, int len, char *buf )
+static int write_file( char *file, unsigned char *buf, uint32_t len )
 {
-	if ( !buf || !mtd || len < 0 )
-		return -1;
-
+	int fd = STDOUT_FILENO;
 	int err = 0;
-	int fd = open( mtd, O_RDONLY );
 
-	if ( fd < 0 ) {
-		printv( "Flash read error: %m\n" );
-		return fd;
+	if ( strlen(file) > 0 ) {
+		fd = open( file, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+		if ( fd < 0 ) {
+			printv( "Open %s failed: %m\n", file );
+			return -1;
+		}
 	}
 
-	if ( offset > 0 )
-		lseek( fd, offset, SEEK_SET );
-
-	if ( read( fd, buf, len ) != len )
+	if ( write( fd, buf, len ) != len )
 		err = -1;
 
-	close( fd );
+	if ( fd != STDOUT_FILENO )
+		close( fd );
 
 	return err;
 }
 
-static int mib_read( char *mtd, unsigned int offset,
-			unsigned char **mib, uint32_t *size )
+/*
+ * Read the section at offset, expand it if it is already compressed,
+ * and write it back out as a COMP image.
+ */
+static int mib_encode_section( mib_ctx_t *ctx, flash_t *fl,
+			       unsigned int offset, char *out )
 {
-	*mib = NULL;
-	mib_hdr_t header;
-	mib_hdr_compr_t header_compr;
-	unsigned int len = 0;
-	int compression = 0;
-	unsigned char *sig = NULL;
-
-	if ( flash_read( mtd, offset,
-			 sizeof(mib_hdr_t), (char *)&header ) )
-	{
-		printv( "probe header failed\n" );
-		return MIB_ERR_GENERIC;
-	}
-
-	if ( !memcmp( MIB_HEADER_COMP_TAG,
-		      header.sig,
-		      MIB_COMPR_TAG_LEN ) )
-	{
-
-		printv( "MIB is compressed!\n" );
-
-		if ( flash_read( mtd, offset, sizeof(mib_hdr_compr_t),
-						(char *)&header_compr ) )
-		{
-			printv( "read header failed\n" );
-			return MIB_ERR_GENERIC;
+	unsigned char *buf = NULL;
+	unsigned char *sect = NULL;
+	unsigned char *comp = NULL;
+	/* an H6 source is hardware settings, COMP keeps its own tag */
+	char type[ MIB_TAG_LEN + 1 ] = MIB_HEADER_COMPHS_TAG;
+	mib_hdr_compr_t *header;
+	uint32_t size = 0;
+	int len, clen;
+	int err = -1;
+
+	len = mib_read( ctx, fl, offset, &buf, &size );
+	if ( len < 0 && len != MIB_ERR_COMPRESSED )
+		goto out;
+
+	if ( len == MIB_ERR_COMPRESSED ) {
+		header = (mib_hdr_compr_t *)flash_map( fl, offset,
+						       sizeof(*header) );
+		if ( !header )
+			goto out;
+		memcpy( type, header->sig + MIB_COMPR_TAG_LEN, MIB_TAG_LEN );
+		len = mib_decode( buf, size, &sect, NULL, NULL );
+		if ( len < (int)sizeof(mib_hdr_t) ) {
+			printv( "MIB decode failed\n" );
+			goto out;
 		}
-		sig = header_compr.sig;
-		len = swap32(header_compr.len);
-		compression = swap16(header_compr.factor);
-	} else if ( !memcmp( MIB_HEADER_TAG, header.sig, MIB_TAG_LEN ) ) {
-		sig = header.sig;
-		len = swap16(header.len);
-	} else {
-		printv("Invalid MIB header!\n");
-		return MIB_ERR_GENERIC;
-	}
-
-	printv( "Header info:\n" );
-	if ( compression ) {
-		printv( "  signature: '%.6s'\n", sig );
-		printv( "  compression factor: 0x%x\n", compression );
+		buf = sect;
 	} else {
-		printv( "  signature: '%.2s'\n", sig );
-	}
-	printv( "  data size: 0x%x\n", len );
-
-	*mib = (unsigned char *)malloc(len);
-
-	if ( compression ) {
-		*size = len;
-		if ( flash_read( mtd, offset + sizeof(mib_hdr_compr_t),
-				 len, (char *)*mib ) )
-		{
-			printv( "MIB read failed\n" );
-			return MIB_ERR_GENERIC;
-		}
-		return MIB_ERR_COMPRESSED;
-	}
-
-	if ( flash_read( mtd, offset + sizeof(mib_hdr_t),
-			 len, (char *)*mib ) )
-	{
-		printv( "MIB read failed\n" );
-		return MIB_ERR_GENERIC;
-	}
-
-	return len;
-}
-
-#define RING_SIZE       4096    /* size of ring buffer, must be power of 2 */
-#define UL_MATCH        18      /* upper limit for match_length */
-#define THRESHOLD       2       /* encode string into position and length
-                                 * if match_length is greater than this */
-static int mib_decode( unsigned char *in, uint32_t len, unsigned char **out )
-{
-	if ( !in || !out || len < 1 )
-		return -1;
-
-	int  i, j, k, c;
-	int r = RING_SIZE - UL_MATCH;
-	unsigned int flags = 0;
-	unsigned int pos = 0;
-	unsigned int explen = 0;
-
-	unsigned char *text_buf =
-			(unsigned char *)malloc( RING_SIZE + UL_MATCH - 1 );
-	if ( !text_buf )
-		return -1;
-
-	*out = (unsigned char *)malloc( len );
-	if ( !*out ) {
-		free(text_buf);
-		return -1;
-	}
-
-	/* original code initializes text_buf with spaces */
-	memset( text_buf, ' ', r );
-	memset( *out, 0, len );
-
-	while (1) {
-		if ( ((flags >>= 1) & 0x100) == 0 ) {
-			if ( pos++ > len )
-				break;
-			c = *in++;		/* get flags for frame */
-			flags = c | 0xff00;	/* uses higher byte cleverly */
-		}				/* to count eight */
-		/* test next flag bit */
-		if ( flags & 1 ) {
-			/* flag bit of 1 means unencoded byte */
-			if ( pos++ > len )
-				break;
-			c = *in++;
-			if ( explen + 1 > len )
-				*out = (unsigned char *)realloc( *out, explen + 1 );
-			(*out)[ explen ] = c;	/* copy to output */
-			//printf("%i: %x\n", explen, c); fflush(stdout);
-			explen++;
-			text_buf[ r ] = c;	/* and to text_buf */
-			r++;
-			r &= (RING_SIZE - 1);
-		} else {
-			/* 0 means encoded info */
-			if ( pos++ > len )
-				break;
-			i = *in++;		/* get position */
-			if ( pos++ > len )
-				break;
-			j = *in++;		/* get length of run */
-
-			i |= ((j & 0xf0) << 4);	    /* i is now offset of run */
-			j = (j & 0x0f) + THRESHOLD; /* j is the length */
-
-			for ( k = 0; k <= j; k++ ) {
-				c = text_buf[ (i + k) & (RING_SIZE - 1) ];
-				if ( explen + 1 > len )
-					*out = (unsigned char *)realloc( (void *)*out, explen + 1 );
-				(*out)[ explen ] = c;
-				//printf("c%i: %x\n", explen, c); fflush(stdout);
-				explen++;
-				text_buf[ r ] = c;
-				r++;
-				r &= (RING_SIZE - 1);
-			}
+		/*
+		 * readers parse COMP sections as a TLV table, the plain
+		 * struct has to be converted or it reads back as zeroes
+		 */
+		unsigned char sig[ MIB_SIG_LEN ];
+		mib_t *mib;
+
+		memcpy( sig, buf - sizeof(mib_hdr_t), MIB_SIG_LEN );
+		if ( mib_load( ctx, fl, offset, 0, &mib ) < 0 )
+			goto out;
+		len = mib_tlv_section( mib, sig, NULL, 0 );
+		if ( len == MIB_ERR_MISSING ) {
+			printv( "AC tables have no TLV ids, can not encode\n" );
+			goto out;
 		}
+		sect = malloc( len );
+		if ( !sect )
+			goto out;
+		len = mib_tlv_section( mib, sig, sect, len );
+		if ( len < 0 )
+			goto out;
+		buf = sect;
 	}
 
-	free(text_buf);
-	return explen;
-}
-
-static void mibtbl_to_struct( unsigned char *tbl,
-			      uint32_t size,
-			      unsigned char *mib )
-{
-	if ( !tbl || ! mib )
-		return;
-
-	int i = 0;
-	mibtbl_t mibtbl;
-
-	while ( i < size ) {
-		memcpy( &mibtbl, tbl + i, sizeof(mibtbl_t) );
-		i += sizeof(mibtbl_t);
-
-		/* does 0xc900 mean the end of a table? */
-		if( swap16(mibtbl.type) > MIB_TABLE_LIST ) {
-			printv( "Next table with size 0x%02x!\n",
-						swap16(mibtbl.size) );
-			continue;
-		}
-
-		switch ( swap16(mibtbl.type) ) {
-		case 0:
-			printv("End of MIB tables!\n");
-			break;
-		case MIB_HW_BOARD_VER:
-			memcpy( &(((mib_t *)mib)->board_ver),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_NIC0_ADDR:
-			memcpy( &(((mib_t *)mib)->nic0_addr),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_NIC1_ADDR:
-			memcpy( &(((mib_t *)mib)->nic1_addr),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_WLAN_ADDR:
-			memcpy( &(((mib_t *)mib)->wlan->macAddr),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_REG_DOMAIN:
-			memcpy( &(((mib_t *)mib)->wlan->regDomain),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_RF_TYPE:
-			memcpy( &(((mib_t *)mib)->wlan->rfType),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_LED_TYPE:
-			memcpy( &(((mib_t *)mib)->wlan->ledType),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_WSC_PIN:
-			memcpy( &(((mib_t *)mib)->wlan->wscPin),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_XCAP:
-			memcpy( &(((mib_t *)mib)->wlan->xCap),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_WLAN_ADDR1:
-			memcpy( &(((mib_t *)mib)->wlan->macAddr1),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_WLAN_ADDR2:
-			memcpy( &(((mib_t *)mib)->wlan->macAddr2),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_WLAN_ADDR3:
-			memcpy( &(((mib_t *)mib)->wlan->macAddr3),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_WLAN_ADDR4:
-			memcpy( &(((mib_t *)mib)->wlan->macAddr4),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_WLAN_ADDR5:
-			memcpy( &(((mib_t *)mib)->wlan->macAddr5),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_WLAN_ADDR6:
-			memcpy( &(((mib_t *)mib)->wlan->macAddr6),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_WLAN_ADDR7:
-			memcpy( &(((mib_t *)mib)->wlan->macAddr7),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_TSSI1:
-			memcpy( &(((mib_t *)mib)->wlan->TSSI1),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_TSSI2:
-			memcpy( &(((mib_t *)mib)->wlan->TSSI2),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_THER:
-			memcpy( &(((mib_t *)mib)->wlan->Ther),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_TRSWITCH:
-			memcpy( &(((mib_t *)mib)->wlan->trswitch),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_TRSWPAPE_C9:
-			memcpy( &(((mib_t *)mib)->wlan->trswpape_c9),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_TRSWPAPE_CC:
-			memcpy( &(((mib_t *)mib)->wlan->trswpape_cc),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_TARGET_PWR:
-			memcpy( &(((mib_t *)mib)->wlan->target_pwr),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_RESERVED5:
-			memcpy( &(((mib_t *)mib)->wlan->Reserved5),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_RESERVED6:
-			memcpy( &(((mib_t *)mib)->wlan->Reserved6),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_RESERVED7:
-			memcpy( &(((mib_t *)mib)->wlan->Reserved7),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_RESERVED8:
-			memcpy( &(((mib_t *)mib)->wlan->Reserved8),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_CCK_A:
-			memcpy( &(((mib_t *)mib)->wlan->pwrlevelCCK_A),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_CCK_B:
-			memcpy( &(((mib_t *)mib)->wlan->pwrlevelCCK_B),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_HT40_1S_A:
-			memcpy( &(((mib_t *)mib)->wlan->pwrlevelHT40_1S_A),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_HT40_1S_B:
-			memcpy( &(((mib_t *)mib)->wlan->pwrlevelHT40_1S_B),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_DIFF_HT40_2S:
-			memcpy( &(((mib_t *)mib)->wlan->pwrdiffHT40_2S),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_DIFF_HT20:
-			memcpy( &(((mib_t *)mib)->wlan->pwrdiffHT20),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_DIFF_OFDM:
-			memcpy( &(((mib_t *)mib)->wlan->pwrdiffOFDM),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_RESERVED9:
-			memcpy( &(((mib_t *)mib)->wlan->Reserved9),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_11N_RESERVED10:
-			memcpy( &(((mib_t *)mib)->wlan->Reserved10),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_5G_HT40_1S_A:
-			memcpy( &(((mib_t *)mib)->wlan->pwrlevel5GHT40_1S_A),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_5G_HT40_1S_B:
-			memcpy( &(((mib_t *)mib)->wlan->pwrlevel5GHT40_1S_B),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_DIFF_5G_HT40_2S:
-			memcpy( &(((mib_t *)mib)->wlan->pwrdiff5GHT40_2S),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_DIFF_5G_HT20:
-			memcpy( &(((mib_t *)mib)->wlan->pwrdiff5GHT20),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		case MIB_HW_TX_POWER_DIFF_5G_OFDM:
-			memcpy( &(((mib_t *)mib)->wlan->pwrdiff5GOFDM),
-					tbl + i,
-					swap16(mibtbl.size) );
-			break;
-		default:
-			printv( "unknown field (type %i) found,"
-				"containing data:\n",
-				swap16(mibtbl.type) );
-			if ( verbose )
-				print_hex( tbl + i, swap16(mibtbl.size) );
-			break;
-		}
-
-		i += swap16(mibtbl.size);
+	clen = mib_encode( buf, len, type, &comp, NULL, NULL );
+	if ( clen < 0 ) {
+		printv( "MIB encode failed\n" );
+		goto out;
 	}
-}
+	printv( "Encoded 0x%x bytes into 0x%x\n", len, clen );
 
-static int hex_to_string( unsigned char *hex, char *str, int len )
-{
-	int i;
-	unsigned char *d, *s;
-	const static char hexdig[] = "0123456789abcdef";
-
-	if ( hex == NULL || str == NULL )
-		return -1;
+	err = write_file( out, comp, clen );
 
-	d = (unsigned char *)str;
-	s = hex;
-
-	for ( i = 0; i < len; i++,s++ ) {
-		*d++ = hexdig[(*s >> 4) & 0xf];
-		*d++ = hexdig[*s & 0xf];
-	}
-
-	*d = 0;
-	return 0;
+out:
+	free(sect);
+	free(comp);
+	return err;
 }
 
-#ifdef HAVE_RTK_AC_SUPPORT
-
+/* AC boards keep the 5G diffs per channel group, expand to channels */
 #define B1_G1	40
 #define B1_G2	48
 
@@ -582,8 +449,6 @@ static int hex_to_string( unsigned char *hex, char *str, int len )
 
 void assign_diff_AC(unsigned char* pMib, unsigned char* pVal)
 {
-	int x=0, y=0;
-
 	memset((pMib+35), pVal[0], (B1_G1-35));
 	memset((pMib+B1_G1), pVal[1], (B1_G2-B1_G1));
 	memset((pMib+B1_G2), pVal[2], (B2_G1-B1_G2));
@@ -601,275 +466,2043 @@ void assign_diff_AC(unsigned char* pMib, unsigned char* pVal)
 
 }
 
-void assign_diff_AC_hex_to_string(unsigned char* pmib,char* str,int len)
+/* one NAME=hex row of the calibration dump */
+static void tx_row( mib_out_t *o, const char *name,
+		    const unsigned char *val, unsigned int len )
 {
-	char mib_buf[MAX_5G_CHANNEL_NUM_MIB];
-	memset(mib_buf,0,sizeof(mib_buf));
-	assign_diff_AC(mib_buf, pmib);
-	hex_to_string(mib_buf,str,MAX_5G_CHANNEL_NUM_MIB);
+	mib_out_str( o, name );
+	mib_out_char( o, '=' );
+	mib_out_hex( o, val, len );
+	mib_out_char( o, '\n' );
 }
-#endif /* HAVE_RTK_AC_SUPPORT */
 
-void set_tx_calibration( mib_wlan_t *phw, char *interface )
+/* an AC per group diff, expanded to channels first */
+static void tx_row_AC( mib_out_t *o, const char *name,
+		       unsigned char *val )
 {
-	if( !phw )
-		return;
-
-	char p[ MAX_5G_CHANNEL_NUM_MIB * 2 + 1 ];
-
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrlevelCCK_A, p, MAX_2G_CHANNEL_NUM_MIB );
-	printf( "pwrlevelCCK_A=%s\n", p );
-
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrlevelCCK_B, p, MAX_2G_CHANNEL_NUM_MIB );
-	printf( "pwrlevelCCK_B=%s\n", p );
+	unsigned char buf[ MAX_5G_CHANNEL_NUM_MIB ];
 
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrlevelHT40_1S_A, p, MAX_2G_CHANNEL_NUM_MIB );
-	printf( "pwrlevelHT40_1S_A=%s\n", p );
-
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrlevelHT40_1S_B, p, MAX_2G_CHANNEL_NUM_MIB );
-	printf( "pwrlevelHT40_1S_B=%s\n", p );
-
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrdiffHT40_2S, p, MAX_2G_CHANNEL_NUM_MIB );
-	printf( "pwrdiffHT40_2S=%s\n", p );
-
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrdiffHT20, p, MAX_2G_CHANNEL_NUM_MIB );
-	printf( "pwrdiffHT20=%s\n", p );
-
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrdiffOFDM, p, MAX_2G_CHANNEL_NUM_MIB );
-	printf( "pwrdiffOFDM=%s\n", p );
+	memset( buf, 0, sizeof(buf) );
+	assign_diff_AC( buf, val );
+	tx_row( o, name, buf, MAX_5G_CHANNEL_NUM_MIB );
+}
 
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrlevel5GHT40_1S_A, p, MAX_5G_CHANNEL_NUM_MIB );
-	printf( "pwrlevel5GHT40_1S_A=%s\n", p );
+void set_tx_calibration( mib_out_t *o, mib_wlan_t *phw, char *interface,
+			 int ac )
+{
+	if( !phw )
+		return;
 
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrlevel5GHT40_1S_B, p, MAX_5G_CHANNEL_NUM_MIB );
-	printf( "pwrlevel5GHT40_1S_B=%s\n", p );
+	tx_row( o, "pwrlevelCCK_A", phw->pwrlevelCCK_A,
+		MAX_2G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrlevelCCK_B", phw->pwrlevelCCK_B,
+		MAX_2G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrlevelHT40_1S_A", phw->pwrlevelHT40_1S_A,
+		MAX_2G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrlevelHT40_1S_B", phw->pwrlevelHT40_1S_B,
+		MAX_2G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrdiffHT40_2S", phw->pwrdiffHT40_2S,
+		MAX_2G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrdiffHT20", phw->pwrdiffHT20, MAX_2G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrdiffOFDM", phw->pwrdiffOFDM, MAX_2G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrlevel5GHT40_1S_A", phw->pwrlevel5GHT40_1S_A,
+		MAX_5G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrlevel5GHT40_1S_B", phw->pwrlevel5GHT40_1S_B,
+		MAX_5G_CHANNEL_NUM_MIB );
 
 #ifdef HAVE_RTK_92D_SUPPORT
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrdiff5GHT40_2S, p, MAX_5G_CHANNEL_NUM_MIB );
-	printf( "pwrdiff5GHT40_2S=%s\n", p );
-
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrdiff5GHT20, p, MAX_5G_CHANNEL_NUM_MIB );
-	printf( "pwrdiff5GHT20=%s\n", p );
-
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrdiff5GOFDM, p, MAX_5G_CHANNEL_NUM_MIB );
-	printf( "pwrdiff5GOFDM=%s\n", p );
+	tx_row( o, "pwrdiff5GHT40_2S", phw->pwrdiff5GHT40_2S,
+		MAX_5G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrdiff5GHT20", phw->pwrdiff5GHT20,
+		MAX_5G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrdiff5GOFDM", phw->pwrdiff5GOFDM,
+		MAX_5G_CHANNEL_NUM_MIB );
 #endif /* HAVE_RTK_92D_SUPPORT */
 
-#ifdef HAVE_RTK_AC_SUPPORT /* 8812 */
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrdiff_20BW1S_OFDM1T_A, p, MAX_2G_CHANNEL_NUM_MIB );
-	printf( "pwrdiff_20BW1S_OFDM1T_A=%s\n", p );
-
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrdiff_40BW2S_20BW2S_A, p, MAX_2G_CHANNEL_NUM_MIB );
-	printf( "pwrdiff_40BW2S_20BW2S_A=%s\n", p );
+	/* 8812 */
+	if ( !ac )
+		return;
 
-	memset( p, 0, sizeof(p) );
-	assign_diff_AC_hex_to_string( phw->pwrdiff_5G_20BW1S_OFDM1T_A, p, MAX_5G_DIFF_NUM );
-	printf( "pwrdiff_5G_20BW1S_OFDM1T_A=%s\n", p );
+	tx_row( o, "pwrdiff_20BW1S_OFDM1T_A", phw->pwrdiff_20BW1S_OFDM1T_A,
+		MAX_2G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrdiff_40BW2S_20BW2S_A", phw->pwrdiff_40BW2S_20BW2S_A,
+		MAX_2G_CHANNEL_NUM_MIB );
+	tx_row_AC( o, "pwrdiff_5G_20BW1S_OFDM1T_A",
+		   phw->pwrdiff_5G_20BW1S_OFDM1T_A );
+	tx_row_AC( o, "pwrdiff_5G_40BW2S_20BW2S_A",
+		   phw->pwrdiff_5G_40BW2S_20BW2S_A );
+	tx_row_AC( o, "pwrdiff_5G_80BW1S_160BW1S_A",
+		   phw->pwrdiff_5G_80BW1S_160BW1S_A );
+	tx_row_AC( o, "pwrdiff_5G_80BW2S_160BW2S_A",
+		   phw->pwrdiff_5G_80BW2S_160BW2S_A );
+	tx_row( o, "pwrdiff_20BW1S_OFDM1T_B", phw->pwrdiff_20BW1S_OFDM1T_B,
+		MAX_2G_CHANNEL_NUM_MIB );
+	tx_row( o, "pwrdiff_40BW2S_20BW2S_B", phw->pwrdiff_40BW2S_20BW2S_B,
+		MAX_2G_CHANNEL_NUM_MIB );
+	tx_row_AC( o, "pwrdiff_5G_20BW1S_OFDM1T_B",
+		   phw->pwrdiff_5G_20BW1S_OFDM1T_B );
+	tx_row_AC( o, "pwrdiff_5G_40BW2S_20BW2S_B",
+		   phw->pwrdiff_5G_40BW2S_20BW2S_B );
+	tx_row_AC( o, "pwrdiff_5G_80BW1S_160BW1S_B",
+		   phw->pwrdiff_5G_80BW1S_160BW1S_B );
+	tx_row_AC( o, "pwrdiff_5G_80BW2S_160BW2S_B",
+		   phw->pwrdiff_5G_80BW2S_160BW2S_B );
+}
 
-	memset( p, 0, sizeof(p) );
-	assign_diff_AC_hex_to_string( phw->pwrdiff_5G_40BW2S_20BW2S_A, p, MAX_5G_DIFF_NUM );
-	printf( "pwrdiff_5G_40BW2S_20BW2S_A=%s\n", p );
+static void mib_area_print( FILE *fp, const mib_area_t *area )
+{
+	const mib_area_sect_t *sect;
+	int i;
 
-	memset( p, 0, sizeof(p) );
-	assign_diff_AC_hex_to_string( phw->pwrdiff_5G_80BW1S_160BW1S_A, p, MAX_5G_DIFF_NUM );
-	printf( "pwrdiff_5G_80BW1S_160BW1S_A=%s\n", p );
+	for ( i = 0; i < MIB_SECTS; i++ ) {
+		sect = &area->sect[i];
+		if ( sect->data_len )
+			fprintf( fp, "%s 0x%06x %s len=0x%x data=0x%x\n",
+				 mib_sect_names[i], sect->offset,
+				 sect->compressed ? "COMP" : "H6", sect->len,
+				 sect->data_len );
+	}
+}
 
-	memset( p, 0, sizeof(p) );
-	assign_diff_AC_hex_to_string( phw->pwrdiff_5G_80BW2S_160BW2S_A, p, MAX_5G_DIFF_NUM );
-	printf( "pwrdiff_5G_80BW2S_160BW2S_A=%s\n", p );
+static int mib_scan_print( const mib_section_t *sect, void *arg )
+{
+	printf( "0x%06zx %s len=0x%x data=0x%x\n", sect->offset, sect->sig,
+		sect->len, sect->data_len );
+	return 0;
+}
 
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrdiff_20BW1S_OFDM1T_B, p, MAX_2G_CHANNEL_NUM_MIB );
-	printf( "pwrdiff_20BW1S_OFDM1T_B=%s\n", p );
+static int mib_scan_image( flash_t *fl, mib_realloc_t alloc, void *arg )
+{
+	unsigned char *img;
+	int found;
 
-	memset( p, 0, sizeof(p) );
-	hex_to_string( phw->pwrdiff_40BW2S_20BW2S_B, p, MAX_2G_CHANNEL_NUM_MIB );
-	printf( "pwrdiff_40BW2S_20BW2S_B=%s\n", p );
+	if ( fl->size < 1 ) {
+		printv( "Unknown input size\n" );
+		return -1;
+	}
 
-	memset( p, 0, sizeof(p) );
-	assign_diff_AC_hex_to_string( phw->pwrdiff_5G_20BW1S_OFDM1T_B, p, MAX_5G_DIFF_NUM );
-	printf( "pwrdiff_5G_20BW1S_OFDM1T_B=%s\n", p );
+	img = flash_map( fl, 0, fl->size );
+	if ( !img ) {
+		printv( "Flash read error: %m\n" );
+		return -1;
+	}
 
-	memset( p, 0, sizeof(p) );
-	assign_diff_AC_hex_to_string( phw->pwrdiff_5G_40BW2S_20BW2S_B, p, MAX_5G_DIFF_NUM );
-	printf( "pwrdiff_5G_40BW2S_20BW2S_B=%s\n", p );
+	found = mib_scan( img, fl->size, mib_scan_print, NULL, alloc, arg );
+	if ( !found )
+		printf( "No MIB sections found\n" );
 
-	memset( p, 0, sizeof(p) );
-	assign_diff_AC_hex_to_string( phw->pwrdiff_5G_80BW1S_160BW1S_B, p, MAX_5G_DIFF_NUM );
-	printf( "pwrdiff_5G_80BW1S_160BW1S_B=%s\n", p );
+	return found;
+}
 
-	memset( p, 0, sizeof(p) );
-	assign_diff_AC_hex_to_string( phw->pwrdiff_5G_80BW2S_160BW2S_B, p, MAX_5G_DIFF_NUM );
-	printf( "pwrdiff_5G_80BW2S_160BW2S_B=%s\n", p );
-#endif /* HAVE_RTK_AC_SUPPORT */
+static void analysis_put( FILE *fp, int json, const char *key,
+			  unsigned long val )
+{
+	if ( json )
+		fprintf( fp, ",\n\t\"%s\": %lu", key, val );
+	else
+		fprintf( fp, "%s=%lu\n", key, val );
 }
 
-int main( int argc, char **argv )
+static void analysis_hist( FILE *fp, int json, const char *key,
+			   const uint32_t *hist, unsigned int n )
 {
-	int efuse = 0; /* HAVE_RTK_EFUSE */
+	unsigned int i;
 
-	char infile[ 255 ] = "";
-	char outfile[ 255 ] = "";
-	unsigned int mib_offset = MIB_OFFSET;
-	uint32_t get = MIB_HW_BOARD_VER;
+	fprintf( fp, json ? ",\n\t\"%s\": [ " : "%s='", key );
+	for ( i = 0; i < n; i++ )
+		fprintf( fp, json && i ? ", %u" : i ? " %u" : "%u", hist[i] );
+	fprintf( fp, json ? " ]" : "'\n" );
+}
 
-	int opt;
-	int option_index = 0;
-	while ( (opt = getopt_long( argc, argv,
-					opt_string, long_options,
-					&option_index )) != -1 )
-	{
-		switch( opt ) {
-		case 'g':
-			if ( !strncmp( optarg, "macs", 5 ) ) {
-				get = MIB_HW_MACS;
-			} else if ( !strncmp( optarg, "mac0", 5 ) ) {
-				get = MIB_HW_NIC0_ADDR;
-			} else if ( !strncmp( optarg, "mac1", 5 ) ) {
-				get = MIB_HW_NIC1_ADDR;
-			} else if ( !strncmp( optarg, "wmac0", 6 ) ) {
-				get = MIB_HW_WLAN_ADDR;
-			} else if ( !strncmp( optarg, "wcal", 5 ) ) {
-				get = MIB_HW_WCAL;
-			} else if ( !strncmp( optarg, "ver", 4 ) ) {
-				get = MIB_HW_BOARD_VER;
-			}
-			break;
-		case 'i':
-			snprintf( infile, sizeof infile, "%s", optarg );
-			break;
-		case 'o':
-			mib_offset = (unsigned int)atoi(optarg);
-			break;
-		case 'O':
-			snprintf( outfile, sizeof outfile, "%s", optarg );
-			break;
-		case 'h':
-			usage(argv[0]);
-			exit(EXIT_SUCCESS);
-		case 'v':
-			verbose = 1;
-			break;
-		case '?':
-		default:
-			printf( "%s: option -%c is invalid\n", argv[0], optopt );
-			exit(EXIT_FAILURE);
+/* -a: the whole report, KEY=value lines or a single JSON object */
+static void mib_analysis_print( FILE *fp, const mib_analysis_t *an,
+				int json )
+{
+	const lzss_analysis_t *lz = &an->lzss;
+	const mibtbl_stats_t *tbl = &an->tbl;
+	const mibtbl_type_stats_t *t;
+	unsigned int i, sep = 0;
+
+	fprintf( fp, json ? "{\n\t\"compressed\": %d" : "compressed=%d\n",
+		 an->compressed );
+	analysis_put( fp, json, "hdr_len", an->hdr_len );
+	analysis_put( fp, json, "len", an->len );
+	analysis_put( fp, json, "data_len", an->data_len );
+	if ( an->compressed ) {
+		analysis_put( fp, json, "factor", an->factor );
+		/* decoded bytes per payload byte, in hundredths */
+		analysis_put( fp, json, "ratio_x100",
+			      an->len ? an->data_len * 100UL / an->len : 0 );
+		analysis_put( fp, json, "lzss_in", lz->in );
+		analysis_put( fp, json, "lzss_literals", lz->literals );
+		analysis_put( fp, json, "lzss_matches", lz->matches );
+		analysis_put( fp, json, "lzss_match_bytes", lz->match_bytes );
+		analysis_put( fp, json, "lzss_pad_bytes", lz->pad_bytes );
+		/* lengths start at THRESHOLD + 1, the rest are always 0 */
+		analysis_hist( fp, json, "lzss_len_hist",
+			       lz->len_hist + THRESHOLD + 1,
+			       UL_MATCH - THRESHOLD );
+		analysis_hist( fp, json, "lzss_dist_hist", lz->dist_hist,
+			       LZSS_DIST_BUCKETS );
+
+		analysis_put( fp, json, "tlv_tables", tbl->tables );
+		analysis_put( fp, json, "tlv_fields", tbl->fields );
+		analysis_put( fp, json, "tlv_bytes", tbl->bytes );
+		analysis_put( fp, json, "tlv_unknown", tbl->unknown );
+		analysis_put( fp, json, "tlv_truncated", tbl->truncated );
+		analysis_put( fp, json, "tlv_overflow", tbl->overflow );
+
+		fprintf( fp, json ? ",\n\t\"tlv_unknown_ids\": [ " :
+			 "tlv_unknown_ids='" );
+		for ( i = 0; i < tbl->ntypes; i++ ) {
+			if ( tbl->types[i].known )
+				continue;
+			fprintf( fp, sep++ ? json ? ", %u" : " %u" : "%u",
+				 tbl->types[i].type );
+		}
+		fprintf( fp, json ? " ]" : "'\n" );
+
+		/* type count bytes min max per id */
+		if ( json )
+			fprintf( fp, ",\n\t\"tlv\": [" );
+		for ( i = 0; i < tbl->ntypes; i++ ) {
+			t = &tbl->types[i];
+			if ( json )
+				fprintf( fp, "%s\n\t\t{ \"type\": %u, "
+					 "\"known\": %s, \"count\": %u, "
+					 "\"bytes\": %u, \"min\": %u, "
+					 "\"max\": %u }", i ? "," : "",
+					 t->type, t->known ? "true" : "false",
+					 t->count, t->bytes, t->min, t->max );
+			else
+				fprintf( fp, "tlv_%u='%u %u %u %u'\n", t->type,
+					 t->count, t->bytes, t->min, t->max );
 		}
+		if ( json )
+			fprintf( fp, "\n\t]" );
 	}
+	if ( json )
+		fprintf( fp, "\n}\n" );
+}
 
-	if ( strlen(infile) < 1 )
-		snprintf( infile, sizeof infile, "%s", FLASH_DEVICE_NAME );
+/*
+ * -g on a single member: MIB_GET_FIELD with the mib_fields[] index and
+ * the interface, kept clear of the MIB_HW_* ids
+ */
+#define MIB_GET_FIELD			0x10000
+#define MIB_GET_FIELD_ID( field, wlan )	(MIB_GET_FIELD | (wlan) << 8 | (field))
 
-	unsigned char *buf = NULL;
-	unsigned char *mib = NULL;
-	unsigned char *tmp = NULL;
-	int mib_len = 0;
-	uint32_t size = 0;
+/* fields needed to answer a -g query, and their end as mib_query_want() */
+static uint32_t mib_get_want( uint32_t get, mibtbl_want_t *want )
+{
+	static const unsigned short macs[] = {
+		MIB_HW_WLAN_ADDR, MIB_HW_WLAN_ADDR1, MIB_HW_WLAN_ADDR2,
+		MIB_HW_WLAN_ADDR3, MIB_HW_WLAN_ADDR4, MIB_HW_WLAN_ADDR5,
+		MIB_HW_WLAN_ADDR6, MIB_HW_WLAN_ADDR7,
+	};
+	const mib_field_t *f;
+	unsigned int i, type;
 
-	if ( efuse ) {
-		printv( "Efuse enabled. Nothing to do!\n" );
-		exit(EXIT_SUCCESS);
+	memset( want, 0, sizeof(mibtbl_want_t) );
+
+	switch ( get ) {
+	case MIB_HW_MACS:
+		mibtbl_want_id( want, MIB_HW_NIC0_ADDR, 0 );
+		mibtbl_want_id( want, MIB_HW_NIC1_ADDR, 0 );
+		for ( i = 0; i < sizeof(macs) / sizeof(macs[0]); i++ )
+			mibtbl_want_id( want, macs[i], 0 );
+		break;
+	case MIB_HW_NIC0_ADDR:
+	case MIB_HW_NIC1_ADDR:
+	case MIB_HW_WLAN_ADDR:
+		mibtbl_want_id( want, get, 0 );
+		break;
+	case MIB_HW_WCAL:
+		for ( i = 0; i < NUM_WLAN_INTERFACE; i++ )
+			for ( type = MIB_HW_TX_POWER_CCK_A;
+			      type <= MIB_HW_TX_POWER_DIFF_5G_OFDM; type++ )
+				if ( type != MIB_HW_11N_RESERVED9 &&
+				     type != MIB_HW_11N_RESERVED10 )
+					mibtbl_want_id( want, type, i );
+		break;
+	case MIB_HW_BOARD_VER:
+	default:
+		if ( get & MIB_GET_FIELD ) {
+			f = &mib_fields[ get & 0xff ];
+			i = f->wlan ? get >> 8 & 0xff : 0;
+			mibtbl_want_field( want, get & 0xff, i );
+			return f->offset + i * sizeof(mib_wlan_t) + f->size;
+		}
+		mibtbl_want_id( want, MIB_HW_BOARD_VER, 0 );
+		break;
 	}
 
-	mib_len = mib_read( infile, mib_offset,	&buf, &size );
+	return mibtbl_want_end( want );
+}
 
-	if ( mib_len == MIB_ERR_GENERIC )
-		goto exit;
+static void mib_arena_error( void )
+{
+#ifdef MIB_STATIC_ARENA
+	printf( "MIB section does not fit the 0x%zx byte static arena, "
+		"rebuild with a larger MIB_ARENA_SLACK\n", arena.size );
+#else
+	printv( "Out of memory\n" );
+#endif
+}
 
-	if ( mib_len == MIB_ERR_COMPRESSED ) {
-		mib_len = mib_decode( buf, size, &tmp );
+static const struct {
+	const char *name;
+	uint32_t get;
+} mib_get_names[] = {
+	{ "macs", MIB_HW_MACS },
+	{ "mac0", MIB_HW_NIC0_ADDR },
+	{ "mac1", MIB_HW_NIC1_ADDR },
+	{ "wmac0", MIB_HW_WLAN_ADDR },
+	{ "wcal", MIB_HW_WCAL },
+	{ "ver", MIB_HW_BOARD_VER },
+};
 
-		printv( "Compressed size: %i\n", size );
-		mib_hdr_t *header = (mib_hdr_t *)tmp;
-		printv( "Header signature: '%.2s'\n", header->sig );
-		printv( "Length from header: 0x%x\n", swap16(header->len) );
-		printv( "Decoded length: 0x%x\n", mib_len );
-		printv( "Expected mininum len: 0x%x\n", (int)sizeof(mib_t) );
-		printv( "Decoded data:\n" );
-		if ( verbose )
-			print_hex( tmp + sizeof(mib_hdr_t), mib_len );
+/*
+ * map a -g name to its MIB_HW_* id, or with fields set to any member
+ * by name, *get is left alone if unknown
+ */
+static int mib_get_parse( const char *name, uint32_t *get, int fields )
+{
+	unsigned int i, wlan;
+	int field;
 
-		free(buf);
-		buf = (unsigned char *)malloc( sizeof(mib_t) );
-		memset( buf, 0, sizeof(mib_t) );
-		mibtbl_to_struct( tmp + sizeof(mib_hdr_t), mib_len, buf );
+	for ( i = 0; i < sizeof(mib_get_names) / sizeof(mib_get_names[0]); i++ ) {
+		if ( !strcmp( name, mib_get_names[i].name ) ) {
+			*get = mib_get_names[i].get;
+			return 0;
+		}
 	}
 
-	mib = buf;
+	field = fields ? mib_field_find( name, &wlan ) : -1;
+	if ( field < 0 )
+		return -1;
 
-	if ( mib_len < (int)sizeof(mib_t) ) {
-		printv( "MIB length invalid!\n" );
-		goto exit;
+	*get = MIB_GET_FIELD_ID( field, wlan );
+	return 0;
+}
+
+/* a member's value as -q prints it, quoted for sh or JSON */
+static void mib_field_put( mib_out_t *o, const mib_field_t *f,
+			   const unsigned char *val, int json )
+{
+	unsigned int j, len;
+
+	switch ( f->fmt ) {
+	case MIB_FMT_INT:
+		mib_out_uint( o, *val );
+		break;
+	case MIB_FMT_MAC:
+		if ( json )
+			mib_out_char( o, '"' );
+		print_mac( o, val );
+		if ( json )
+			mib_out_char( o, '"' );
+		break;
+	case MIB_FMT_HEX:
+		if ( json )
+			mib_out_char( o, '"' );
+		mib_out_hex( o, val, f->size );
+		if ( json )
+			mib_out_char( o, '"' );
+		break;
+	case MIB_FMT_STR:
+		len = strnlen( (char *)val, f->size );
+		mib_out_char( o, json ? '"' : '\'' );
+		for ( j = 0; j < len; j++ ) {
+			if ( !json ) {
+				if ( val[j] == '\'' )
+					mib_out_str( o, "'\\''" );
+				else
+					mib_out_char( o, val[j] );
+			} else if ( val[j] == '"' || val[j] == '\\' ) {
+				mib_out_char( o, '\\' );
+				mib_out_char( o, val[j] );
+			} else if ( val[j] < 0x20 || val[j] >= 0x7f ) {
+				mib_out_str( o, "\\u00" );
+				mib_out_hex( o, &val[j], 1 );
+			} else {
+				mib_out_char( o, val[j] );
+			}
+		}
+		mib_out_char( o, json ? '"' : '\'' );
+		break;
 	}
+}
 
-	printv( "board version: 0x%02x\n", mib[0]);
+static void mib_print( mib_out_t *o, mib_t *mib, uint32_t get )
+{
+	const unsigned char *macs[] = {
+		mib->nic0_addr, mib->nic1_addr,
+		mib->wlan->macAddr, mib->wlan->macAddr1,
+		mib->wlan->macAddr2, mib->wlan->macAddr3,
+		mib->wlan->macAddr4, mib->wlan->macAddr5,
+		mib->wlan->macAddr6, mib->wlan->macAddr7,
+	};
+	unsigned int i;
+	int ac;
 
 	switch (get) {
 	case MIB_HW_MACS:
-		print_mac( (unsigned char *)(((mib_t *)mib)->nic0_addr) );
-		printf("\n");
-		print_mac( (unsigned char *)(((mib_t *)mib)->nic1_addr) );
-		printf("\n");
-		print_mac( (unsigned char *)(((mib_t *)mib)->wlan->macAddr) );
-		printf("\n");
-		print_mac( (unsigned char *)(((mib_t *)mib)->wlan->macAddr1) );
-		printf("\n");
-		print_mac( (unsigned char *)(((mib_t *)mib)->wlan->macAddr2) );
-		printf("\n");
-		print_mac( (unsigned char *)(((mib_t *)mib)->wlan->macAddr3) );
-		printf("\n");
-		print_mac( (unsigned char *)(((mib_t *)mib)->wlan->macAddr4) );
-		printf("\n");
-		print_mac( (unsigned char *)(((mib_t *)mib)->wlan->macAddr5) );
-		printf("\n");
-		print_mac( (unsigned char *)(((mib_t *)mib)->wlan->macAddr6) );
-		printf("\n");
-		print_mac( (unsigned char *)(((mib_t *)mib)->wlan->macAddr7) );
-		printf("\n");
+		for ( i = 0; i < sizeof(macs) / sizeof(macs[0]); i++ ) {
+			print_mac( o, macs[i] );
+			mib_out_char( o, '\n' );
+		}
 		break;
 	case MIB_HW_NIC0_ADDR:
-		print_mac( (unsigned char *)(((mib_t *)mib)->nic0_addr) );
+		print_mac( o, mib->nic0_addr );
 		break;
 	case MIB_HW_NIC1_ADDR:
-		print_mac( (unsigned char *)(((mib_t *)mib)->nic1_addr) );
+		print_mac( o, mib->nic1_addr );
 		break;
 	case MIB_HW_WLAN_ADDR:
-		print_mac( (unsigned char *)(((mib_t *)mib)->wlan->macAddr) );
+		print_mac( o, mib->wlan->macAddr );
 		break;
 	case MIB_HW_WCAL:
-		set_tx_calibration( (mib_wlan_t *)( mib + MIB_WLAN_OFFSET ),
-								  "wlan0" );
-#ifdef HAVE_RTK_DUAL_BAND_SUPPORT
-		set_tx_calibration((mib_wlan_t *)
-				   ( mib + MIB_WLAN_OFFSET + sizeof(mib_wlan_t),
-								  "wlan1" );
-#endif
+		ac = mib_layouts[ mib->layout ].ac;
+		set_tx_calibration( o, &mib->wlan[0], "wlan0", ac );
+		if ( mib->wlan_num > 1 )
+			set_tx_calibration( o, &mib->wlan[1], "wlan1", ac );
 		break;
 	case MIB_HW_BOARD_VER:
 	default:
-		printf( "Board version: %i\n",
-			(((mib_t *)mib)->board_ver) );
+		if ( get & MIB_GET_FIELD ) {
+			mib_field_put( o, &mib_fields[ get & 0xff ],
+				       mib_field_value( mib, get & 0xff,
+							get >> 8 & 0xff ), 0 );
+		} else {
+			mib_out_str( o, "Board version: " );
+			mib_out_uint( o, mib->board_ver );
+			mib_out_char( o, '\n' );
+		}
 		break;
 	}
+}
 
-exit:
-	free(buf);
-	if ( mib != buf )
-		free(tmp);
+/* field queries by name, see mib_field_find() */
+#define MIB_QUERY_MAX	(MIB_FIELDS_NUM * NUM_WLAN_INTERFACE)
+#define MIB_QUERY_TLV_MAX	64
+
+#define MIB_OUT_SH	0
+#define MIB_OUT_JSON	1
+
+typedef struct mib_query {
+	unsigned int num;
+	struct {
+		unsigned short field;	/* index into mib_fields[] */
+		unsigned char wlan;
+		unsigned char all;	/* from "all", skip if not present */
+	} item[ MIB_QUERY_MAX ];
+	/* raw TLVs by id: hs.<id>[.<n>], ds.<id>[.<n>], cs.all, ... */
+	unsigned int tlv_num;
+	struct {
+		unsigned char sect;	/* MIB_SECT_* */
+		unsigned char all;	/* every field of the section */
+		unsigned short type;
+		unsigned short nth;	/* occurrence, 0 for the first */
+	} tlv[ MIB_QUERY_TLV_MAX ];
+	int format;
+} mib_query_t;
+
+static void mib_query_add( mib_query_t *q, unsigned int field,
+			   unsigned int wlan, int all )
+{
+	unsigned int i;
+
+	for ( i = 0; i < q->num; i++ )
+		if ( q->item[i].field == field && q->item[i].wlan == wlan )
+			return;
+
+	q->item[ q->num ].field = field;
+	q->item[ q->num ].wlan = wlan;
+	q->item[ q->num ].all = all;
+	q->num++;
+}
+
+/* <sect>.<id>[.<n>] or <sect>.all, 1 if name is not of that form */
+static int mib_query_add_tlv( mib_query_t *q, const char *name )
+{
+	unsigned int i, sect;
+	unsigned long type, nth = 0;
+	char *end;
+
+	for ( sect = 0; sect < MIB_SECTS; sect++ )
+		if ( !strncmp( name, mib_sect_names[ sect ], 2 ) &&
+		     name[2] == '.' )
+			break;
+	if ( sect == MIB_SECTS )
+		return 1;
+	name += 3;
+
+	if ( !strcmp( name, "all" ) ) {
+		type = 0;
+	} else {
+		type = strtoul( name, &end, 0 );
+		if ( end == name || !type || type >= MIB_TABLE_LIST )
+			return -1;
+		if ( *end == '.' ) {
+			name = end + 1;
+			nth = strtoul( name, &end, 10 );
+			if ( end == name || nth > 0xffff )
+				return -1;
+		}
+		if ( *end )
+			return -1;
+	}
+
+	for ( i = 0; i < q->tlv_num; i++ )
+		if ( q->tlv[i].sect == sect && q->tlv[i].type == type &&
+		     q->tlv[i].nth == nth )
+			return 0;
+	if ( q->tlv_num == MIB_QUERY_TLV_MAX )
+		return -1;
+
+	q->tlv[ q->tlv_num ].sect = sect;
+	q->tlv[ q->tlv_num ].all = !type;
+	q->tlv[ q->tlv_num ].type = type;
+	q->tlv[ q->tlv_num ].nth = nth;
+	q->tlv_num++;
+	return 0;
+}
+
+static int mib_query_add_name( mib_query_t *q, const char *name )
+{
+	unsigned int i, wlan = 0;
+	int field;
+
+	field = mib_query_add_tlv( q, name );
+	if ( field <= 0 )
+		return field;
+
+	if ( !strcmp( name, "all" ) ) {
+		for ( i = 0; i < MIB_FIELDS_NUM; i++ )
+			if ( !mib_fields[i].wlan )
+				mib_query_add( q, i, 0, 1 );
+		for ( wlan = 0; wlan < NUM_WLAN_INTERFACE; wlan++ )
+			for ( i = 0; i < MIB_FIELDS_NUM; i++ )
+				if ( mib_fields[i].wlan )
+					mib_query_add( q, i, wlan, 1 );
+		return 0;
+	}
+
+	field = mib_field_find( name, &wlan );
+	if ( field < 0 )
+		return -1;
+
+	mib_query_add( q, field, wlan, 0 );
+	return 0;
+}
+
+/* parse a comma separated list of field names, or "all" */
+static int mib_query_parse( mib_query_t *q, const char *list, FILE *fp )
+{
+	char *names, *name, *save;
+	int err = 0;
+
+	names = strdup( list );
+	if ( !names )
+		return -1;
+
+	for ( name = strtok_r( names, ",", &save ); name;
+	      name = strtok_r( NULL, ",", &save ) ) {
+		if ( mib_query_add_name( q, name ) ) {
+			fprintf( fp, "unknown field: %s\n", name );
+			err = -1;
+			break;
+		}
+	}
+
+	free( names );
+	return err;
+}
+
+/* -w edits, applied together by mib_set() */
+#define MIB_SET_MAX	32
+
+/* NAME=VALUE, the value is checked here and stays in arg */
+static int mib_edit_parse( mib_edit_t *e, char *arg )
+{
+	static mib_t scratch;
+	char *eq = strchr( arg, '=' );
+	int field;
+
+	if ( !eq )
+		return -1;
+	*eq = 0;
+	field = mib_field_find( arg, &e->wlan );
+	*eq = '=';
+	if ( field < 0 ||
+	     mib_field_parse( field, eq + 1,
+			      mib_field_value( &scratch, field, e->wlan ) ) )
+		return -1;
+
+	e->field = field;
+	e->value = eq + 1;
+	return 0;
+}
+
+/*
+ * TLV fields the query needs from the table, and the end of the last
+ * queried member for plain images, which carry mib_t as it is.
+ */
+static uint32_t mib_query_want( const mib_query_t *q, mibtbl_want_t *want )
+{
+	const mib_field_t *f;
+	uint32_t end = 0, off;
+	unsigned int i;
+
+	memset( want, 0, sizeof(mibtbl_want_t) );
+
+	for ( i = 0; i < q->num; i++ ) {
+		f = &mib_fields[ q->item[i].field ];
+		off = f->offset;
+		if ( f->wlan )
+			off += q->item[i].wlan * sizeof(mib_wlan_t);
+		if ( off + f->size > end )
+			end = off + f->size;
+
+		mibtbl_want_field( want, q->item[i].field, q->item[i].wlan );
+	}
+
+	return end;
+}
+
+/* times type came up in the table before pos */
+static unsigned int mibtbl_nth( const unsigned char *tbl, uint32_t size,
+				uint32_t pos, unsigned int type )
+{
+	unsigned int t, n = 0;
+	uint32_t at = 0, len;
+
+	while ( mibtbl_next( tbl, size, &at, &t, &len ) && at < pos )
+		n += t == type;
+
+	return n;
+}
+
+static void mib_query_tlv_put( mib_out_t *o, int json, unsigned int sect,
+			       unsigned int type, unsigned int nth,
+			       const unsigned char *val, uint32_t len,
+			       unsigned int *n )
+{
+	if ( json )
+		mib_out_str( o, (*n)++ ? ",\n\t\"" : "\n\t\"" );
+	mib_out_str( o, mib_sect_names[ sect ] );
+	mib_out_char( o, json ? '.' : '_' );
+	mib_out_uint( o, type );
+	if ( nth ) {
+		mib_out_char( o, json ? '.' : '_' );
+		mib_out_uint( o, nth );
+	}
+	mib_out_str( o, json ? "\": " : "=" );
+
+	if ( !val && json )
+		mib_out_str( o, "null" );
+	if ( val && json )
+		mib_out_char( o, '"' );
+	if ( val )
+		mib_out_hex( o, val, len );
+	if ( val && json )
+		mib_out_char( o, '"' );
+	if ( !json )
+		mib_out_char( o, '\n' );
+}
+
+/* raw TLV answers, unknown ones come out empty without the area */
+static void mib_query_print_tlv( mib_out_t *o, const mib_query_t *q,
+				 const mib_area_t *area, unsigned int *n )
+{
+	const unsigned char *tbl, *val;
+	unsigned int i, type, nth;
+	uint32_t size, pos, len;
+	int json = q->format == MIB_OUT_JSON;
+
+	for ( i = 0; i < q->tlv_num; i++ ) {
+		tbl = val = NULL;
+		size = len = 0;
+		if ( area && area->sect[ q->tlv[i].sect ].data ) {
+			tbl = area->sect[ q->tlv[i].sect ].data +
+							sizeof(mib_hdr_t);
+			size = area->sect[ q->tlv[i].sect ].data_len -
+							sizeof(mib_hdr_t);
+		}
+
+		pos = 0;
+		nth = 0;
+		while ( tbl && (val = mibtbl_next( tbl, size, &pos, &type,
+						   &len )) ) {
+			if ( q->tlv[i].all ) {
+				mib_query_tlv_put( o, json, q->tlv[i].sect,
+					type, mibtbl_nth( tbl, size, pos, type ),
+					val, len, n );
+			} else if ( type == q->tlv[i].type &&
+				    nth++ == q->tlv[i].nth ) {
+				break;
+			}
+		}
+		if ( !q->tlv[i].all )
+			mib_query_tlv_put( o, json, q->tlv[i].sect,
+					   q->tlv[i].type, q->tlv[i].nth,
+					   val, len, n );
+	}
+}
+
+static void mib_query_print( mib_out_t *o, mib_t *mib, const mib_query_t *q,
+			     const mib_area_t *area )
+{
+	const mib_field_t *f;
+	unsigned char *val;
+	unsigned int i, n = 0;
+	int json = q->format == MIB_OUT_JSON;
+
+	if ( json )
+		mib_out_char( o, '{' );
+
+	for ( i = 0; i < q->num; i++ ) {
+		if ( q->item[i].all &&
+		     !mib_field_present( mib, q->item[i].field,
+					 q->item[i].wlan ) )
+			continue;
+		f = &mib_fields[ q->item[i].field ];
+		val = mib_field_value( mib, q->item[i].field, q->item[i].wlan );
+
+		if ( json )
+			mib_out_str( o, n++ ? ",\n\t\"" : "\n\t\"" );
+		if ( f->wlan ) {
+			mib_out_str( o, "wlan" );
+			mib_out_uint( o, q->item[i].wlan );
+			mib_out_char( o, json ? '.' : '_' );
+		}
+		mib_out_str( o, f->name );
+		mib_out_str( o, json ? "\": " : "=" );
+
+		mib_field_put( o, f, val, json );
+
+		if ( !json )
+			mib_out_char( o, '\n' );
+	}
+
+	mib_query_print_tlv( o, q, area, &n );
+
+	if ( json )
+		mib_out_str( o, "\n}\n" );
+}
+
+/*
+ * Batch mode: a pool of workers decodes many images. Every worker owns
+ * a contiguous range of jobs and takes from its front; a worker that
+ * runs dry steals the back half of another worker's range. Results
+ * are collected per job and written out in list order by main().
+ */
+typedef struct batch_job {
+	char *path;
+	char *text;		/* formatted result */
+	int err;
+	int done;
+} batch_job_t;
+
+struct batch;
+
+typedef struct batch_worker {
+	pthread_t thread;
+	pthread_mutex_t lock;	/* protects lo and hi */
+	unsigned int lo, hi;	/* jobs not taken yet */
+	mib_ctx_t *ctx;		/* per worker decode buffers */
+	struct batch *batch;
+} batch_worker_t;
+
+typedef struct batch {
+	batch_job_t *jobs;
+	unsigned int njobs;
+	batch_worker_t *workers;
+	unsigned int nworkers;
+	unsigned int offset;
+	uint32_t get;
+	const mib_query_t *query;	/* overrides get if set */
+	int compare;
+	int verify;		/* checksums only, see mib_verify() */
+	const mib_limits_t *limits;	/* -K: run mib_sanity() instead */
+	pthread_mutex_t lock;	/* protects job done flags */
+	pthread_cond_t done;
+} batch_t;
+
+static int batch_add( batch_t *b, const char *path )
+{
+	batch_job_t *jobs;
+
+	if ( (b->njobs & 63) == 0 ) {
+		jobs = (batch_job_t *)realloc( b->jobs,
+				(b->njobs + 64) * sizeof(batch_job_t) );
+		if ( !jobs )
+			return -1;
+		b->jobs = jobs;
+	}
+
+	memset( &b->jobs[ b->njobs ], 0, sizeof(batch_job_t) );
+	b->jobs[ b->njobs ].path = strdup( path );
+	if ( !b->jobs[ b->njobs ].path )
+		return -1;
+	b->njobs++;
+
+	return 0;
+}
+
+static int batch_cmp( const void *a, const void *b )
+{
+	return strcmp( ((const batch_job_t *)a)->path,
+		       ((const batch_job_t *)b)->path );
+}
+
+/* fill the job list from a directory or a list file */
+static int batch_collect( batch_t *b, const char *src )
+{
+	struct stat st;
+	char path[ PATH_MAX ];
+
+	if ( strcmp( src, "-" ) && !stat( src, &st ) && S_ISDIR(st.st_mode) ) {
+		struct dirent *de;
+		DIR *dir = opendir( src );
+
+		if ( !dir )
+			return -1;
+		while ( (de = readdir( dir )) ) {
+			if ( de->d_name[0] == '.' )
+				continue;
+			snprintf( path, sizeof path, "%s/%s", src, de->d_name );
+			if ( stat( path, &st ) || !S_ISREG(st.st_mode) )
+				continue;
+			if ( batch_add( b, path ) ) {
+				closedir( dir );
+				return -1;
+			}
+		}
+		closedir( dir );
+		qsort( b->jobs, b->njobs, sizeof(batch_job_t), batch_cmp );
+		return 0;
+	}
+
+	FILE *fp = strcmp( src, "-" ) ? fopen( src, "r" ) : stdin;
+	if ( !fp )
+		return -1;
+	while ( fgets( path, sizeof path, fp ) ) {
+		path[ strcspn( path, "\r\n" ) ] = 0;
+		if ( !path[0] )
+			continue;
+		if ( batch_add( b, path ) ) {
+			if ( fp != stdin )
+				fclose( fp );
+			return -1;
+		}
+	}
+	if ( fp != stdin )
+		fclose( fp );
+
+	return 0;
+}
+
+static void batch_run_job( batch_worker_t *w, batch_job_t *job )
+{
+	batch_t *b = w->batch;
+	flash_t flash;
+	mib_t *mib = NULL;
+	size_t size = 0;
+	mib_out_t o;
+	FILE *fp;
+
+	if ( flash_open( &flash, job->path ) ) {
+		job->err = MIB_ERR_IO;
+		asprintf( &job->text, "error: open failed: %m\n" );
+		goto out;
+	}
+
+	if ( b->verify ) {
+		job->err = mib_verify( w->ctx, &flash, b->offset );
+		if ( job->err >= 0 )
+			job->text = strdup( job->err ? "ok\n" :
+						       "no checksum\n" );
+		else
+			asprintf( &job->text, "error: %s\n",
+				  mib_strerror( job->err ) );
+		goto out;
+	}
+
+	job->err = mib_load( w->ctx, &flash, b->offset, b->compare, &mib );
+	if ( job->err < 0 ) {
+		asprintf( &job->text, "error: %s\n",
+			  mib_strerror( job->err ) );
+		goto out;
+	}
+
+	fp = open_memstream( &job->text, &size );
+	if ( !fp ) {
+		job->err = MIB_ERR_GENERIC;
+		goto out;
+	}
+	mib_out_init( &o, fp );
+	if ( b->limits ) {
+		if ( sanity_print( &o, mib, b->limits ) )
+			job->err = MIB_ERR_VALUE;
+	} else if ( b->query )
+		mib_query_print( &o, mib, b->query, NULL );
+	else
+		mib_print( &o, mib, b->get );
+	mib_out_flush( &o );
+	fclose( fp );
+
+out:
+	flash_close( &flash );
+
+	pthread_mutex_lock( &b->lock );
+	job->done = 1;
+	pthread_cond_broadcast( &b->done );
+	pthread_mutex_unlock( &b->lock );
+}
+
+/* take the next job of our own range, or steal from someone else's */
+static int batch_next( batch_worker_t *w )
+{
+	batch_t *b = w->batch;
+	unsigned int i, n, mid;
+	int job = -1;
+
+	pthread_mutex_lock( &w->lock );
+	if ( w->lo < w->hi )
+		job = w->lo++;
+	pthread_mutex_unlock( &w->lock );
+	if ( job >= 0 )
+		return job;
+
+	for ( n = 1; n < b->nworkers && job < 0; n++ ) {
+		batch_worker_t *v = &b->workers[ (w - b->workers + n) %
+							b->nworkers ];
+
+		pthread_mutex_lock( &v->lock );
+		if ( v->hi - v->lo > 1 ) {
+			mid = v->lo + (v->hi - v->lo) / 2;
+			i = v->hi;
+			v->hi = mid;
+			pthread_mutex_unlock( &v->lock );
+
+			pthread_mutex_lock( &w->lock );
+			job = mid;
+			w->lo = mid + 1;
+			w->hi = i;
+			pthread_mutex_unlock( &w->lock );
+		} else {
+			if ( v->lo < v->hi )
+				job = --v->hi;
+			pthread_mutex_unlock( &v->lock );
+		}
+	}
+
+	return job;
+}
+
+static void *batch_worker( void *arg )
+{
+	batch_worker_t *w = (batch_worker_t *)arg;
+	int job;
+
+	while ( (job = batch_next( w )) >= 0 )
+		batch_run_job( w, &w->batch->jobs[ job ] );
+
+	return NULL;
+}
+
+/* print a job result with every line tagged by the image name */
+static void batch_print( mib_out_t *o, batch_job_t *job )
+{
+	char *line = job->text;
+	char *nl;
+
+	while ( line && *line ) {
+		nl = strchr( line, '\n' );
+		mib_out_str( o, job->path );
+		mib_out_str( o, ": " );
+		mib_out_mem( o, line, nl ? (size_t)(nl - line) : strlen( line ) );
+		mib_out_char( o, '\n' );
+		if ( !nl )
+			break;
+		line = nl + 1;
+	}
+}
+
+/* worker messages go to stderr, stdout only carries the tagged results */
+static void batch_log( void *arg, int level, const char *fmt, va_list ap )
+{
+	vfprintf( stderr, fmt, ap );
+}
+
+static mib_ctx_t *batch_ctx( void )
+{
+	mib_ctx_t *ctx = mib_ctx_new( NULL, NULL, batch_log, NULL );
+
+	if ( ctx && verbose )
+		mib_ctx_set_log_level( ctx, MIB_LOG_DEBUG );
+
+	return ctx;
+}
+
+static int batch_main( const char *src, unsigned int nworkers,
+		       unsigned int offset, uint32_t get,
+		       const mib_query_t *query, int compare, int verify,
+		       const mib_limits_t *limits )
+{
+	batch_t b;
+	unsigned int i, started, failed = 0;
+
+	memset( &b, 0, sizeof(b) );
+	b.offset = offset;
+	b.get = get;
+	b.query = query;
+	b.compare = compare;
+	b.verify = verify;
+	b.limits = limits;
+	pthread_mutex_init( &b.lock, NULL );
+	pthread_cond_init( &b.done, NULL );
+
+	if ( batch_collect( &b, src ) ) {
+		printf( "Batch list %s: %m\n", src );
+		return -1;
+	}
+	if ( !b.njobs )
+		return 0;
+
+	if ( nworkers < 1 )
+		nworkers = 1;
+	if ( nworkers > b.njobs )
+		nworkers = b.njobs;
+	b.nworkers = started = nworkers;
+	b.workers = (batch_worker_t *)calloc( nworkers,
+					      sizeof(batch_worker_t) );
+	if ( !b.workers )
+		return -1;
+
+	for ( i = 0; i < nworkers; i++ ) {
+		batch_worker_t *w = &b.workers[i];
+
+		pthread_mutex_init( &w->lock, NULL );
+		w->batch = &b;
+		w->ctx = batch_ctx();
+		if ( !w->ctx ) {
+			while ( i-- )
+				mib_ctx_free( b.workers[i].ctx );
+			free( b.workers );
+			return -1;
+		}
+		w->lo = (uint64_t)b.njobs * i / nworkers;
+		w->hi = (uint64_t)b.njobs * (i + 1) / nworkers;
+	}
+	for ( i = 0; i < nworkers; i++ ) {
+		if ( pthread_create( &b.workers[i].thread, NULL,
+				     batch_worker, &b.workers[i] ) ) {
+			/*
+			 * Run worker i here. It steals the ranges of the
+			 * workers that never started once its own is done,
+			 * as do the threads already going.
+			 */
+			started = i;
+			batch_worker( &b.workers[i] );
+			break;
+		}
+	}
+
+	/*
+	 * emit results in list order as they complete, what is buffered
+	 * goes out whenever we have to wait
+	 */
+	mib_out_init( &cli_out, stdout );
+	for ( i = 0; i < b.njobs; i++ ) {
+		batch_job_t *job = &b.jobs[i];
+
+		pthread_mutex_lock( &b.lock );
+		if ( !job->done ) {
+			pthread_mutex_unlock( &b.lock );
+			mib_out_flush( &cli_out );
+			pthread_mutex_lock( &b.lock );
+		}
+		while ( !job->done )
+			pthread_cond_wait( &b.done, &b.lock );
+		pthread_mutex_unlock( &b.lock );
+
+		batch_print( &cli_out, job );
+		/* the same rule for queries, -c, -V and -K */
+		if ( job->err < 0 )
+			failed++;
+		free( job->text );
+		free( job->path );
+	}
+	mib_out_flush( &cli_out );
+
+	for ( i = 0; i < b.nworkers; i++ ) {
+		if ( i < started )
+			pthread_join( b.workers[i].thread, NULL );
+		mib_ctx_free( b.workers[i].ctx );
+	}
+
+	printv( "%u images, %u failed\n", b.njobs, failed );
+
+	free( b.workers );
+	free( b.jobs );
+
+	return failed ? -1 : 0;
+}
+
+/*
+ * Daemon mode: the MIB is decoded once and kept in memory, queries are
+ * answered on a Unix socket. A request is one line, either a -g name
+ * or a -q field list, optionally prefixed with "json ". The answer is
+ * the same text the command line would print, followed by an empty
+ * line. File inputs are watched with inotify and decoded again when
+ * the section on them changes, SIGHUP forces the same check.
+ */
+#define DAEMON_CLIENTS		32
+#define DAEMON_LINE		512
+
+typedef struct daemon_client {
+	int fd;
+	unsigned int len;
+	char line[ DAEMON_LINE ];
+} daemon_client_t;
+
+typedef struct daemon {
+	const char *infile;
+	unsigned int offset;
+	uint32_t slots;		/* -b slot size, 0 for a plain section */
+	mib_ctx_t *ctx;
+	mib_t mib;		/* last good decode */
+	int err;		/* mib_load() result of the first load */
+	uint64_t fp;		/* fingerprint of the section in mib */
+	int publish;		/* mirror mib to shared memory */
+	daemon_client_t clients[ DAEMON_CLIENTS ];
+} daemon_t;
+
+static volatile sig_atomic_t daemon_stop;
+static volatile sig_atomic_t daemon_reload;
+
+static void daemon_signal( int sig )
+{
+	if ( sig == SIGHUP )
+		daemon_reload = 1;
+	else
+		daemon_stop = 1;
+}
+
+/* decode the image again unless the section is unchanged */
+static void daemon_load( daemon_t *d )
+{
+	flash_t flash;
+	mib_slot_state_t slot;
+	mib_t *mib = NULL;
+	unsigned int offset = d->offset;
+	uint64_t fp;
+	int len;
+
+	if ( flash_open( &flash, d->infile ) ) {
+		printv( "Flash open error: %m\n" );
+		if ( d->err )
+			d->err = MIB_ERR_GENERIC;
+		return;
+	}
+
+	/* a commit may have moved the section to the other slot */
+	if ( d->slots && !mib_slot_select( &flash, d->offset, d->slots, &slot ) )
+		offset = slot.section;
+
+	if ( mib_section_fingerprint( d->ctx, &flash, offset, &fp ) ) {
+		len = MIB_ERR_GENERIC;
+	} else if ( !d->err && fp == d->fp ) {
+		printv( "MIB unchanged\n" );
+		flash_close( &flash );
+		return;
+	} else {
+		len = mib_load( d->ctx, &flash, offset, 0, &mib );
+	}
+
+	if ( len >= 0 ) {
+		memcpy( &d->mib, mib, sizeof(mib_t) );
+		d->fp = fp;
+		d->err = 0;
+		printv( "MIB loaded\n" );
+		if ( d->publish &&
+		     mib_shm_publish( MIB_SHM_NAME, &d->mib, len, fp ) )
+			printv( "Shared memory publish failed: %m\n" );
+	} else {
+		/* keep answering from the last good copy */
+		printv( "MIB load failed: %s\n", mib_strerror( len ) );
+		if ( d->err )
+			d->err = len;
+	}
+
+	flash_close( &flash );
+}
+
+static void daemon_answer( daemon_t *d, int fd, char *line )
+{
+	mib_query_t *q;
+	uint32_t get;
+	char *text = NULL;
+	size_t size = 0;
+	mib_out_t o;
+	FILE *fp;
+	int json = 0;
+
+	fp = open_memstream( &text, &size );
+	if ( !fp )
+		return;
+	mib_out_init( &o, fp );
+
+	if ( !strncmp( line, "json ", 5 ) ) {
+		json = 1;
+		line += 5;
+	}
+
+	if ( d->err ) {
+		fprintf( fp, "error: %s\n", mib_strerror( d->err ) );
+	} else if ( !mib_get_parse( line, &get, 0 ) ) {
+		mib_print( &o, &d->mib, get );
+	} else {
+		q = (mib_query_t *)calloc( 1, sizeof(mib_query_t) );
+		if ( q && !mib_query_parse( q, line, fp ) ) {
+			q->format = json ? MIB_OUT_JSON : MIB_OUT_SH;
+			mib_query_print( &o, &d->mib, q, NULL );
+		}
+		free( q );
+	}
+
+	mib_out_flush( &o );
+	fclose( fp );
+
+	if ( text && size ) {
+		send( fd, text, size, MSG_NOSIGNAL );
+		/* mac0 and friends print no newline of their own */
+		if ( text[ size - 1 ] != '\n' )
+			send( fd, "\n", 1, MSG_NOSIGNAL );
+	}
+	send( fd, "\n", 1, MSG_NOSIGNAL );
+	free( text );
+}
+
+/* read what a client sent, returns -1 once it should be dropped */
+static int daemon_client_read( daemon_t *d, daemon_client_t *c )
+{
+	char *nl, *line;
+	ssize_t n;
+
+	n = recv( c->fd, c->line + c->len, sizeof(c->line) - 1 - c->len, 0 );
+	if ( n <= 0 )
+		return -1;
+	c->len += n;
+	c->line[ c->len ] = 0;
+
+	line = c->line;
+	while ( (nl = strchr( line, '\n' )) ) {
+		*nl = 0;
+		if ( nl > line && nl[-1] == '\r' )
+			nl[-1] = 0;
+		daemon_answer( d, c->fd, line );
+		line = nl + 1;
+	}
+
+	c->len -= line - c->line;
+	memmove( c->line, line, c->len );
+	if ( c->len == sizeof(c->line) - 1 ) {
+		printv( "request too long, dropping client\n" );
+		return -1;
+	}
+
+	return 0;
+}
+
+static int daemon_listen( const char *path )
+{
+	struct sockaddr_un sa;
+	int fd;
+
+	memset( &sa, 0, sizeof(sa) );
+	sa.sun_family = AF_UNIX;
+	if ( strlen(path) >= sizeof(sa.sun_path) ) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy( sa.sun_path, path );
+
+	fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if ( fd < 0 )
+		return -1;
+
+	unlink( path );
+	if ( bind( fd, (struct sockaddr *)&sa, sizeof(sa) ) ||
+	     listen( fd, DAEMON_CLIENTS ) ) {
+		close( fd );
+		return -1;
+	}
+
+	return fd;
+}
+
+/* watch the directory, so files replaced by rename are noticed too */
+static int daemon_watch( const char *infile, char **name )
+{
+	char *dir, *base;
+	struct stat st;
+	int fd;
+
+	*name = NULL;
+	if ( stat( infile, &st ) || !S_ISREG(st.st_mode) )
+		return -1;
+
+	fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	if ( fd < 0 )
+		return -1;
+
+	dir = strdup( infile );
+	base = strdup( infile );
+	if ( !dir || !base ||
+	     inotify_add_watch( fd, dirname( dir ),
+				IN_CLOSE_WRITE | IN_MOVED_TO |
+				IN_CREATE | IN_DELETE ) < 0 ) {
+		free( dir );
+		free( base );
+		close( fd );
+		return -1;
+	}
+
+	*name = strdup( basename( base ) );
+	free( dir );
+	free( base );
+
+	return fd;
+}
+
+/* returns 1 if one of the events is about our file */
+static int daemon_watch_read( int fd, const char *name )
+{
+	char buf[ 4096 ]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t n;
+	char *p;
+	int hit = 0;
+
+	while ( (n = read( fd, buf, sizeof(buf) )) > 0 ) {
+		for ( p = buf; p < buf + n; p += sizeof(*ev) + ev->len ) {
+			ev = (const struct inotify_event *)p;
+			if ( ev->len && !strcmp( ev->name, name ) )
+				hit = 1;
+		}
+	}
+
+	return hit;
+}
+
+static int daemon_main( const char *infile, unsigned int offset,
+			uint32_t slots, const char *path, int publish )
+{
+	struct pollfd pfd[ DAEMON_CLIENTS + 2 ];
+	daemon_client_t *c;
+	struct sigaction sa;
+	daemon_t *d;
+	char *name;
+	int lfd, wfd, fd;
+	unsigned int i, n;
+
+	d = (daemon_t *)calloc( 1, sizeof(daemon_t) );
+	if ( !d )
+		return -1;
+	d->ctx = cli_ctx( NULL, NULL );
+	if ( !d->ctx ) {
+		free( d );
+		return -1;
+	}
+	d->infile = infile;
+	d->offset = offset;
+	d->slots = slots;
+	d->publish = publish;
+	d->err = MIB_ERR_GENERIC;
+	for ( i = 0; i < DAEMON_CLIENTS; i++ )
+		d->clients[i].fd = -1;
+
+	memset( &sa, 0, sizeof(sa) );
+	sa.sa_handler = daemon_signal;
+	sigaction( SIGHUP, &sa, NULL );
+	sigaction( SIGINT, &sa, NULL );
+	sigaction( SIGTERM, &sa, NULL );
+	signal( SIGPIPE, SIG_IGN );
+
+	daemon_load( d );
+
+	lfd = daemon_listen( path );
+	if ( lfd < 0 ) {
+		printf( "Socket %s: %m\n", path );
+		mib_ctx_free( d->ctx );
+		free( d );
+		return -1;
+	}
+	wfd = daemon_watch( infile, &name );
+	printv( "Listening on %s%s\n", path,
+		wfd < 0 ? "" : ", watching the input file" );
+
+	while ( !daemon_stop ) {
+		if ( daemon_reload ) {
+			daemon_reload = 0;
+			daemon_load( d );
+		}
+
+		n = 0;
+		pfd[ n ].fd = lfd;
+		pfd[ n++ ].events = POLLIN;
+		pfd[ n ].fd = wfd;
+		pfd[ n++ ].events = POLLIN;
+		for ( i = 0; i < DAEMON_CLIENTS; i++ ) {
+			pfd[ n ].fd = d->clients[i].fd;
+			pfd[ n++ ].events = POLLIN;
+		}
+
+		if ( poll( pfd, n, -1 ) < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			break;
+		}
+
+		if ( pfd[1].revents & POLLIN )
+			daemon_reload = daemon_watch_read( wfd, name );
+
+		for ( i = 0; i < DAEMON_CLIENTS; i++ ) {
+			c = &d->clients[i];
+			if ( c->fd < 0 || !pfd[ i + 2 ].revents )
+				continue;
+			if ( daemon_client_read( d, c ) ) {
+				close( c->fd );
+				c->fd = -1;
+			}
+		}
+
+		if ( pfd[0].revents & POLLIN ) {
+			fd = accept4( lfd, NULL, NULL, SOCK_CLOEXEC );
+			if ( fd < 0 )
+				continue;
+			for ( i = 0; i < DAEMON_CLIENTS; i++ )
+				if ( d->clients[i].fd < 0 )
+					break;
+			if ( i == DAEMON_CLIENTS ) {
+				close( fd );
+				continue;
+			}
+			/* a stuck client must not hold up the others */
+			struct timeval tv = { 1, 0 };
+			setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO,
+				    &tv, sizeof(tv) );
+			d->clients[i].fd = fd;
+			d->clients[i].len = 0;
+		}
+	}
+
+	for ( i = 0; i < DAEMON_CLIENTS; i++ )
+		if ( d->clients[i].fd >= 0 )
+			close( d->clients[i].fd );
+	if ( wfd >= 0 )
+		close( wfd );
+	close( lfd );
+	unlink( path );
+	free( name );
+	mib_ctx_free( d->ctx );
+	free( d );
+
+	return 0;
+}
+
+/* send one request to a running daemon and print the answer */
+static int daemon_query( const char *path, const char *request, int json )
+{
+	struct sockaddr_un sa;
+	char buf[ 4096 ];
+	ssize_t n;
+	int fd, held = -1, err = 0;
+
+	memset( &sa, 0, sizeof(sa) );
+	sa.sun_family = AF_UNIX;
+	snprintf( sa.sun_path, sizeof(sa.sun_path), "%s", path );
+
+	fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if ( fd < 0 || connect( fd, (struct sockaddr *)&sa, sizeof(sa) ) ) {
+		printv( "Socket %s: %m\n", path );
+		if ( fd >= 0 )
+			close( fd );
+		return -1;
+	}
+
+	dprintf( fd, "%s%s\n", json ? "json " : "", request );
+	shutdown( fd, SHUT_WR );
+
+	/* everything but the empty line that ends the answer */
+	while ( (n = read( fd, buf, sizeof(buf) )) > 0 ) {
+		if ( held < 0 && !strncmp( buf, "error: ", n < 7 ? n : 7 ) )
+			err = -1;
+		if ( held >= 0 )
+			putchar( held );
+		fwrite( buf, 1, n - 1, stdout );
+		held = (unsigned char)buf[ n - 1 ];
+	}
+	close( fd );
+
+	return err;
+}
+
+/*
+ * Answer -g or -q on stdout. With --stats the answer is formatted in
+ * memory first, so formatting and writing are timed apart.
+ */
+static void cli_output( mib_t *mib, uint32_t get, const mib_query_t *q,
+			const mib_area_t *area, mib_stats_t *st )
+{
+	char *buf = NULL;
+	size_t len = 0;
+	uint64_t t = mib_now_ns();
+	FILE *fp = st ? open_memstream( &buf, &len ) : NULL;
+
+	if ( !fp )
+		fp = stdout;
+
+	mib_out_init( &cli_out, fp );
+	if ( q )
+		mib_query_print( &cli_out, mib, q, area );
+	else
+		mib_print( &cli_out, mib, get );
+	mib_out_flush( &cli_out );
+
+	if ( fp == stdout )
+		return;
+
+	fclose( fp );
+	st->ns[ MIB_STAGE_FORMAT ] += mib_now_ns() - t;
+	st->bytes[ MIB_STAGE_FORMAT ] += len;
+
+	t = mib_now_ns();
+	fwrite( buf, 1, len, stdout );
+	fflush( stdout );
+	st->ns[ MIB_STAGE_WRITE ] += mib_now_ns() - t;
+	st->bytes[ MIB_STAGE_WRITE ] += len;
+	free( buf );
+}
+
+/* add what the library measured to the caller's stages */
+static void cli_stats_merge( mib_stats_t *st, mib_ctx_t *ctx )
+{
+	const mib_stats_t *lib;
+	int i;
+
+	if ( !ctx )
+		return;
+
+	lib = mib_ctx_stats( ctx );
+	for ( i = 0; i < MIB_STAGES; i++ ) {
+		st->ns[i] += lib->ns[i];
+		st->bytes[i] += lib->bytes[i];
+	}
+}
+
+int main( int argc, char **argv )
+{
+	int efuse = 0; /* HAVE_RTK_EFUSE */
+
+	char infile[ 255 ] = "";
+	char outfile[ 255 ] = "";
+	char batch[ 255 ] = "";
+	unsigned int mib_offset = MIB_OFFSET;
+	uint32_t slots = 0;
+	uint32_t get = MIB_HW_BOARD_VER;
+	int compare = 0;
+	int encode = 0;
+	int scan = 0;
+	int analyze = 0;
+	int verify = 0;
+	int check = 0;
+	static mib_limits_t limits;
+	int sections = 0;
+	int stream = 0;
+	int cache = 0;
+	int publish = 0;
+	int stats = 0;
+	char *get_name = "ver";
+	int get_given = 0;
+	char *query_list = NULL;
+	char *daemon_socket = NULL;
+	char *client_socket = NULL;
+	static mib_query_t query;
+	mib_query_t *q = NULL;
+	static mib_edit_t edits[ MIB_SET_MAX ];
+	unsigned int edit_num = 0;
+	static flash_sim_t sim;
+	char *sim_spec = NULL;
+	long jobs = sysconf( _SC_NPROCESSORS_ONLN );
+
+	int opt;
+	int option_index = 0;
+
+	mib_limits_default( &limits );
+	while ( (opt = getopt_long( argc, argv,
+					opt_string, long_options,
+					&option_index )) != -1 )
+	{
+		switch( opt ) {
+		case 'g':
+			mib_get_parse( optarg, &get, 1 );
+			get_name = optarg;
+			get_given = 1;
+			break;
+		case 'q':
+			if ( mib_query_parse( &query, optarg, stdout ) )
+				exit(EXIT_FAILURE);
+			q = &query;
+			query_list = optarg;
+			break;
+		case 'f':
+			if ( !strcmp( optarg, "json" ) ) {
+				query.format = MIB_OUT_JSON;
+			} else if ( !strcmp( optarg, "sh" ) ) {
+				query.format = MIB_OUT_SH;
+			} else {
+				printf( "%s: unknown format %s\n",
+					argv[0], optarg );
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'i':
+			snprintf( infile, sizeof infile, "%s", optarg );
+			break;
+		case 'o':
+			mib_offset = (unsigned int)atoi(optarg);
+			break;
+		case 'b':
+			slots = strtoul( optarg, NULL, 0 );
+			break;
+		case 'O':
+			snprintf( outfile, sizeof outfile, "%s", optarg );
+			break;
+		case 'P':
+			publish = 1;
+			break;
+		case 'C':
+			cache = 1;
+			break;
+		case 'c':
+			compare = 1;
+			break;
+		case 'e':
+			encode = 1;
+			break;
+		case 'w':
+			if ( edit_num == MIB_SET_MAX ) {
+				printf( "At most %u fields can be set at once\n",
+					MIB_SET_MAX );
+				exit(EXIT_FAILURE);
+			}
+			if ( mib_edit_parse( &edits[ edit_num ], optarg ) ) {
+				printf( "invalid field assignment: %s\n", optarg );
+				exit(EXIT_FAILURE);
+			}
+			edit_num++;
+			break;
+		case 'F':
+			if ( flash_sim_parse( &sim, optarg ) ) {
+				printf( "invalid flash simulator setting: %s\n",
+					optarg );
+				exit(EXIT_FAILURE);
+			}
+			sim_spec = optarg;
+			break;
+		case 'B':
+			snprintf( batch, sizeof batch, "%s", optarg );
+			break;
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		case 's':
+			scan = 1;
+			break;
+		case 'a':
+			analyze = 1;
+			break;
+		case 'V':
+			verify = 1;
+			break;
+		case 'K':
+			check = 1;
+			break;
+		case 'L':
+			if ( mib_limits_parse( &limits, optarg ) ) {
+				printf( "invalid limits: %s\n", optarg );
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'A':
+			sections = 1;
+			break;
+		case 'd':
+			daemon_socket = optarg;
+			break;
+		case 'S':
+			client_socket = optarg;
+			break;
+		case 't':
+			stats = 1;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+		case 'v':
+			verbose = 1;
+			break;
+		case '?':
+		default:
+			printf( "%s: option -%c is invalid\n", argv[0], optopt );
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if ( strlen(batch) > 0 ) {
+		if ( batch_main( batch, jobs, mib_offset, get, q, compare,
+				 verify, check ? &limits : NULL ) )
+			exit(EXIT_FAILURE);
+		exit(EXIT_SUCCESS);
+	}
+
+	if ( client_socket ) {
+		if ( daemon_query( client_socket, q ? query_list : get_name,
+				   q && query.format == MIB_OUT_JSON ) )
+			exit(EXIT_FAILURE);
+		exit(EXIT_SUCCESS);
+	}
+
+	if ( strlen(infile) < 1 )
+		snprintf( infile, sizeof infile, "%s", FLASH_DEVICE_NAME );
+
+	/* raw TLVs come from the settings area */
+	if ( q && query.tlv_num )
+		sections = 1;
+
+	if ( daemon_socket ) {
+		if ( daemon_main( infile, mib_offset, slots, daemon_socket,
+				  publish ) )
+			exit(EXIT_FAILURE);
+		exit(EXIT_SUCCESS);
+	}
+
+#ifdef MIB_STATIC_ARENA
+	mib_arena_init( &arena, arena_buf, sizeof(arena_buf) );
+	setvbuf( stdout, stdout_buf, _IOFBF, sizeof(stdout_buf) );
+#endif
+
+	uint64_t start = mib_now_ns(), t;
+	cli_heap_t heap = { CLI_ALLOC };
+	mib_realloc_t alloc;
+	void *alloc_arg;
+	mib_stats_t st;
+	const char *path = "flash";
+
+#ifdef MIB_STATIC_ARENA
+	/* the arena is sized for queries, -w takes its buffers from libc */
+	if ( edit_num ) {
+		heap.next = NULL;
+		heap.next_arg = NULL;
+	}
+#endif
+	alloc = heap.next;
+	alloc_arg = heap.next_arg;
+
+	memset( &st, 0, sizeof(st) );
+	if ( stats ) {
+		alloc = cli_heap_realloc;
+		alloc_arg = &heap;
+	}
+
+	flash_t flash = { .fd = -1 };
+	mib_ctx_t *ctx = cli_ctx( alloc, alloc_arg );
+	mib_t cached;
+	mib_t *mib = NULL;
+	int mib_len = 0;
+
+	if ( efuse ) {
+		printv( "Efuse enabled. Nothing to do!\n" );
+		exit(EXIT_SUCCESS);
+	}
+
+	if ( !ctx )
+		exit(EXIT_FAILURE);
+
+	/*
+	 * Plain queries go through the streaming pipeline, the full decode
+	 * is kept for the modes that want to look at everything.
+	 */
+	if ( !strcmp( infile, "-" ) ) {
+		if ( encode || scan || analyze || sections || edit_num ||
+		     slots || sim_spec || check ||
+		     ( verify && !get_given && !q ) ) {
+			printf( "%s: stdin can only be used for queries\n",
+				argv[0] );
+			exit(EXIT_FAILURE);
+		}
+		stream = 1;
+	} else if ( !verbose && !compare && !encode && !scan && !analyze &&
+		    !sections && !cache && !publish && !edit_num && !slots &&
+		    !sim_spec && !check && ( !verify || get_given || q ) ) {
+		stream = 1;
+	}
+
+	if ( stream ) {
+		mibtbl_want_t want;
+		uint32_t end;
+		mib_t mib;
+		int fd, piped = 1;
+
+		t = mib_now_ns();
+		if ( !strcmp( infile, "-" ) ) {
+			fd = STDIN_FILENO;
+		} else if ( flash_open( &flash, infile ) ) {
+			fd = -1;
+		} else {
+			fd = flash.fd;
+			/* named pipes are read as they come */
+			piped = lseek( fd, 0, SEEK_CUR ) < 0;
+			flash_set_alloc( &flash, alloc, alloc_arg );
+		}
+		st.ns[ MIB_STAGE_OPEN ] += mib_now_ns() - t;
+
+		if ( fd < 0 ) {
+			printv( "Flash open error: %m\n" );
+			exit(EXIT_SUCCESS);
+		}
+		if ( q ) {
+			end = mib_query_want( q, &want );
+		} else {
+			end = mib_get_want( get, &want );
+		}
+		if ( piped )
+			mib_len = mib_stream_load( ctx, fd, mib_offset, &want,
+						   end, verify, &mib );
+		else
+			mib_len = mib_stream_map( ctx, &flash, mib_offset,
+						  &want, end, verify, &mib );
+		if ( mib_len == MIB_ERR_NOMEM ) {
+			mib_arena_error();
+			exit(EXIT_FAILURE);
+		}
+		if ( mib_len < 0 && ( get_given || q ) ) {
+			printf( "error: %s\n", mib_strerror( mib_len ) );
+			exit(EXIT_FAILURE);
+		}
+		if ( mib_len >= 0 )
+			cli_output( &mib, get, q, NULL, stats ? &st : NULL );
+		path = "stream";
+		goto exit;
+	}
+
+	t = mib_now_ns();
+	if ( (edit_num ? flash_open_rw : flash_open)( &flash, infile ) ) {
+		printv( "Flash open error: %m\n" );
+		if ( edit_num )
+			exit(EXIT_FAILURE);
+		goto exit;
+	}
+	flash_set_alloc( &flash, alloc, alloc_arg );
+	if ( sim_spec )
+		flash_sim_attach( &flash, &sim );
+	st.ns[ MIB_STAGE_OPEN ] += mib_now_ns() - t;
+
+	if ( edit_num ) {
+		unsigned int blocks;
+
+		if ( slots )
+			mib_len = mib_slot_set( ctx, &flash, mib_offset, slots,
+						edits, edit_num, &blocks );
+		else
+			mib_len = mib_set( ctx, &flash, mib_offset, edits,
+					   edit_num, &blocks );
+		if ( mib_len == MIB_ERR_NOMEM ) {
+			mib_arena_error();
+			exit(EXIT_FAILURE);
+		}
+		if ( mib_len < 0 ) {
+			printf( "Set failed: %s\n", mib_strerror( mib_len ) );
+			exit(EXIT_FAILURE);
+		}
+		printv( "Rewrote %d of %u erase blocks\n", mib_len, blocks );
+		path = "set";
+		goto exit;
+	}
+
+	if ( slots ) {
+		mib_slot_state_t slot;
+
+		if ( mib_slot_select( &flash, mib_offset, slots, &slot ) ) {
+			printf( "Invalid slot size 0x%x\n", slots );
+			exit(EXIT_FAILURE);
+		}
+		if ( slot.active < 0 )
+			printv( "No valid slot, reading the section at 0x%x\n",
+				mib_offset );
+		else
+			printv( "Using slot %c, sequence %u\n",
+				'A' + slot.active, slot.seq );
+		mib_offset = slot.section;
+	}
+
+	if ( verify && !get_given && !q ) {
+		mib_len = mib_verify( ctx, &flash, mib_offset );
+		if ( mib_len == MIB_ERR_NOMEM ) {
+			mib_arena_error();
+			exit(EXIT_FAILURE);
+		}
+		if ( mib_len < 0 ) {
+			printf( "error: %s\n", mib_strerror( mib_len ) );
+			exit(EXIT_FAILURE);
+		}
+		printf( mib_len ? "ok\n" : "no checksum\n" );
+		path = "verify";
+		goto exit;
+	}
+
+	if ( scan ) {
+#ifdef MIB_STATIC_ARENA
+		/* an image that can not be mapped is read whole */
+		flash_set_alloc( &flash, NULL, NULL );
+#endif
+		if ( mib_scan_image( &flash, alloc, alloc_arg ) < 1 )
+			exit(EXIT_FAILURE);
+		exit(EXIT_SUCCESS);
+	}
+
+	if ( analyze ) {
+		mib_analysis_t an;
+
+		mib_len = mib_analyze( ctx, &flash, mib_offset, &an );
+		if ( mib_len < 0 ) {
+			printv( "MIB analysis failed: %s\n",
+				mib_strerror( mib_len ) );
+			exit(EXIT_FAILURE);
+		}
+		mib_analysis_print( stdout, &an,
+				    query.format == MIB_OUT_JSON );
+		exit(EXIT_SUCCESS);
+	}
+
+	if ( sections ) {
+		mib_area_t area;
+
+		mib_len = mib_area_load( ctx, &flash, mib_offset,
+					 MIB_AREA_SIZE, &area );
+		if ( mib_len == MIB_ERR_NOMEM ) {
+			mib_arena_error();
+			exit(EXIT_FAILURE);
+		}
+		if ( mib_len < 0 ) {
+			printv( "No MIB sections found\n" );
+			goto exit;
+		}
+		if ( q || get_given )
+			cli_output( &area.hs, get, q, &area,
+				    stats ? &st : NULL );
+		else
+			mib_area_print( stdout, &area );
+		mib_area_free( ctx, &area );
+		path = "area";
+		goto exit;
+	}
+
+	if ( encode ) {
+		if ( mib_encode_section( ctx, &flash, mib_offset, outfile ) )
+			exit(EXIT_FAILURE);
+		exit(EXIT_SUCCESS);
+	}
+
+	char cache_path[ PATH_MAX ];
+	uint64_t fp = 0;
+
+	if ( ( cache || publish ) &&
+	     mib_section_fingerprint( ctx, &flash, mib_offset, &fp ) )
+		cache = publish = 0;
+	if ( cache && mib_cache_path( cache_path, sizeof(cache_path),
+				      infile, mib_offset ) )
+		cache = 0;
+
+	mib_len = -1;
+	if ( cache ) {
+		t = mib_now_ns();
+		mib_len = mib_cache_load( cache_path, fp, &cached );
+		st.ns[ MIB_STAGE_CACHE ] += mib_now_ns() - t;
+		if ( mib_len >= 0 ) {
+			printv( "Using cached MIB from %s\n", cache_path );
+			st.bytes[ MIB_STAGE_CACHE ] += sizeof(mib_cache_hdr_t) +
+							mib_len;
+			mib = &cached;
+			path = "cache";
+		}
+	}
+
+	if ( mib_len < 0 ) {
+		mib_len = mib_load( ctx, &flash, mib_offset, compare, &mib );
+		t = mib_now_ns();
+		if ( cache && mib_len >= 0 &&
+		     mib_cache_store( cache_path, fp, mib, mib_len ) )
+			printv( "Cache write to %s failed: %m\n", cache_path );
+		st.ns[ MIB_STAGE_CACHE ] += mib_now_ns() - t;
+	}
+
+	if ( mib_len == MIB_ERR_MISMATCH ) {
+		mib_ctx_free( ctx );
+		flash_close( &flash );
+		exit(EXIT_FAILURE);
+	}
+	if ( mib_len == MIB_ERR_NOMEM ) {
+		mib_arena_error();
+		mib_ctx_free( ctx );
+		flash_close( &flash );
+		exit(EXIT_FAILURE);
+	}
+	if ( mib_len < 0 && ( get_given || q ) ) {
+		printf( "error: %s\n", mib_strerror( mib_len ) );
+		mib_ctx_free( ctx );
+		flash_close( &flash );
+		exit(EXIT_FAILURE);
+	}
+	if ( mib_len < 0 )
+		goto exit;
+
+	if ( check ) {
+		unsigned int n;
+
+		mib_out_init( &cli_out, stdout );
+		n = sanity_print( &cli_out, mib, &limits );
+		mib_out_flush( &cli_out );
+		if ( n ) {
+			mib_ctx_free( ctx );
+			flash_close( &flash );
+			exit(EXIT_FAILURE);
+		}
+		goto exit;
+	}
+
+	if ( publish && mib_shm_publish( MIB_SHM_NAME, mib, mib_len, fp ) )
+		printv( "Shared memory publish failed: %m\n" );
+
+	cli_output( mib, get, q, NULL, stats ? &st : NULL );
+
+exit:
+	cli_stats_merge( &st, ctx );
+	mib_ctx_free( ctx );
+	flash_close( &flash );
+	if ( stats )
+		print_stats( stderr, &st, &heap, sim_spec ? &sim : NULL,
+			     path, mib_now_ns() - start,
+			     query.format == MIB_OUT_JSON );
+#ifdef MIB_STATIC_ARENA
+	printv( "Arena: peak 0x%zx of 0x%zx bytes\n", arena.peak, arena.size );
+#endif
 
 	exit(EXIT_SUCCESS);
 }
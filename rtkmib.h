@@ -5,12 +5,45 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <errno.h>
 
 #define __PACK__		__attribute__((packed))
 
+static inline int is_big_endian( void )
+{
+	union {
+		uint32_t i;
+		char c[4];
+	} e = { 0x01000000 };
+
+	return e.c[0];
+}
+
+static inline uint16_t swap16( uint16_t x )
+{
+	return is_big_endian()? x : ((x >> 8) & 0xff) | (x << 8);
+}
+
+static inline uint32_t swap32( uint32_t x )
+{
+	return is_big_endian()? x :
+				(x >> 24) |
+				((x << 8) & 0x00ff0000) |
+				((x >> 8) & 0x0000ff00) |
+				(x << 24);
+}
+
 #define MIB_ERR_GENERIC		-1
 #define MIB_ERR_COMPRESSED	-2
+#define MIB_ERR_DECODE		-3
+#define MIB_ERR_MISMATCH	-4
+#define MIB_ERR_LENGTH		-5
+#define MIB_ERR_NOMEM		-6
+#define MIB_ERR_IO		-7
+#define MIB_ERR_VALUE		-8
+#define MIB_ERR_MISSING		-9
+#define MIB_ERR_CHECKSUM	-10
 
 
 #define FLASH_DEVICE_NAME	"/dev/mtdblock0"
@@ -23,6 +56,11 @@
 #define MIB_OFFSET		MIB_OFFSET_DEFAULT
 #endif
 
+/* hardware, default and current settings follow each other from here */
+#ifndef MIB_AREA_SIZE
+#define MIB_AREA_SIZE		0xa000
+#endif
+
 #define HW_SETTING_VER		3 /* hw setting version */
 
 #define MIB_HEADER_TAG		"H6"
@@ -36,6 +74,7 @@ typedef struct mib_hdr
 
 #define MIB_HEADER_COMP_TAG	"COMP"
 #define MIB_HEADER_COMPHS_TAG	"HS"
+#define MIB_HEADER_COMPDS_TAG	"DS"
 #define MIB_HEADER_COMPCS_TAG	"CS"
 #define MIB_COMPR_TAG_LEN	4
 #define MIB_COMPR_SIG_LEN	6
@@ -46,11 +85,12 @@ typedef struct mib_hdr_compr
 	uint32_t len;
 } __PACK__ mib_hdr_compr_t;
 
-#ifdef HAVE_RTK_DUAL_BAND_SUPPORT
+/*
+ * mib_t has room for the largest board: two interfaces, every one with
+ * the AC tables. What a given section holds is found at run time, see
+ * MIB_LAYOUTS in mib.h.
+ */
 #define NUM_WLAN_INTERFACE		2
-#else
-#define NUM_WLAN_INTERFACE		1
-#endif
 
 #define MAX_2G_CHANNEL_NUM_MIB		14
 #define MAX_5G_CHANNEL_NUM_MIB		196
@@ -99,7 +139,7 @@ typedef struct mib_wlan
 #define PIN_LEN 8
 	unsigned char wscPin[ PIN_LEN + 1 ];
 
-#ifdef HAVE_RTK_AC_SUPPORT
+	/* AC boards only */
 	unsigned char pwrdiff_20BW1S_OFDM1T_A[ MAX_2G_CHANNEL_NUM_MIB ];
 	unsigned char pwrdiff_40BW2S_20BW2S_A[ MAX_2G_CHANNEL_NUM_MIB ];
 	unsigned char pwrdiff_OFDM2T_CCK2T_A[ MAX_2G_CHANNEL_NUM_MIB ];
@@ -135,9 +175,11 @@ typedef struct mib_wlan
 	unsigned char pwrdiff_5G_80BW2S_160BW2S_B[ MAX_5G_DIFF_NUM ];
 	unsigned char pwrdiff_5G_80BW3S_160BW3S_B[ MAX_5G_DIFF_NUM ];
 	unsigned char pwrdiff_5G_80BW4S_160BW4S_B[ MAX_5G_DIFF_NUM ];
-#endif
 } __PACK__ mib_wlan_t;
 
+/* a wlan interface on boards without the AC tables */
+#define MIB_WLAN_BASE_SIZE	offsetof(mib_wlan_t, pwrdiff_20BW1S_OFDM1T_A)
+
 typedef struct mib_wlan_ac
 {
 	unsigned char pwrdiff_20BW1S_OFDM1T_A[ MAX_2G_CHANNEL_NUM_MIB ];
@@ -181,4 +223,11 @@ typedef struct mib
 	unsigned char nic0_addr[6];
 	unsigned char nic1_addr[6];
 	mib_wlan_t wlan[ NUM_WLAN_INTERFACE ];
+
+	/* set by the loader, not part of any section */
+	unsigned char wlan_num;	/* interfaces the section carries */
+	unsigned char layout;	/* MIB_LAYOUT_* it was read with */
 } __PACK__ mib_t;
+
+/* smallest plain section: a single interface without the AC tables */
+#define MIB_SIZE_MIN		(MIB_WLAN_OFFSET + MIB_WLAN_BASE_SIZE)
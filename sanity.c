@@ -0,0 +1,313 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "rtkmib.h"
+#include "mibtbl.h"
+#include "lzss.h"
+#include "flash.h"
+#include "mib.h"
+#include "sanity.h"
+
+enum {
+	SANITY_PWR,		/* power level table */
+	SANITY_DIFF,		/* power difference table */
+	SANITY_MAC,		/* has to be set */
+	SANITY_MAC_OPT,		/* may be zero */
+	SANITY_THER,
+	SANITY_XCAP,
+	SANITY_TSSI,
+};
+
+typedef struct sanity_field {
+	unsigned short field;	/* index into mib_fields[] */
+	unsigned char check;	/* SANITY_* */
+	unsigned char band;	/* tables: 0 for 2.4 GHz, 1 for 5 GHz */
+} sanity_field_t;
+
+/* the fields that get checked, sorted out from their names once */
+static sanity_field_t sanity_fields[ MIB_FIELDS_NUM ];
+static unsigned int sanity_num;
+static pthread_once_t sanity_once = PTHREAD_ONCE_INIT;
+
+static void sanity_init( void )
+{
+	const mib_field_t *f;
+	sanity_field_t *s;
+	unsigned int i;
+
+	for ( i = 0; i < MIB_FIELDS_NUM; i++ ) {
+		f = &mib_fields[i];
+		s = &sanity_fields[ sanity_num ];
+		s->field = i;
+		s->band = 0;
+
+		if ( f->fmt == MIB_FMT_MAC ) {
+			s->check = !strcmp( f->name, "nic0_addr" ) ||
+				   !strcmp( f->name, "macAddr" ) ?
+					SANITY_MAC : SANITY_MAC_OPT;
+		} else if ( f->fmt == MIB_FMT_HEX ) {
+			s->check = strncmp( f->name, "pwrlevel", 8 ) ?
+					SANITY_DIFF : SANITY_PWR;
+			s->band = strstr( f->name, "5G" ) != NULL;
+		} else if ( !strcmp( f->name, "Ther" ) ) {
+			s->check = SANITY_THER;
+		} else if ( !strcmp( f->name, "xCap" ) ) {
+			s->check = SANITY_XCAP;
+		} else if ( !strncmp( f->name, "TSSI", 4 ) ) {
+			s->check = SANITY_TSSI;
+		} else {
+			continue;
+		}
+		sanity_num++;
+	}
+}
+
+#define SANITY_ONES	0x0101010101010101ULL
+#define SANITY_HIGH	0x8080808080808080ULL
+
+/*
+ * A word at a time: every byte the same as the first, and if max is
+ * below 0x80, any byte above it (adding 0x7f - max to the low seven
+ * bits carries into the top bit exactly for those). Returns the first
+ * byte above max, -1 if there is none.
+ */
+static int sanity_scan( const unsigned char *p, uint32_t len,
+			unsigned char max, int *uniform )
+{
+	const uint64_t first = p[0] * SANITY_ONES;
+	const uint64_t add = (0x7f - (max & 0x7f)) * SANITY_ONES;
+	uint64_t w, diff = 0, over = 0;
+	uint32_t i = 0;
+
+	for ( ; i + sizeof(w) <= len; i += sizeof(w) ) {
+		memcpy( &w, p + i, sizeof(w) );
+		diff |= w ^ first;
+		over |= ((w & ~SANITY_HIGH) + add) | w;
+	}
+	for ( ; i < len; i++ ) {
+		diff |= p[i] ^ p[0];
+		over |= p[i] > max ? SANITY_HIGH : 0;
+	}
+	*uniform = !diff;
+
+	/* which byte it was is only looked for once something is */
+	if ( max == 0xff || (max < 0x80 && !(over & SANITY_HIGH)) )
+		return -1;
+	for ( i = 0; i < len; i++ )
+		if ( p[i] > max )
+			return p[i];
+	return -1;
+}
+
+static void sanity_add( mib_issue_t *issues, unsigned int max,
+			unsigned int *n, unsigned int field,
+			unsigned int wlan, unsigned int kind, int value )
+{
+	if ( *n < max ) {
+		issues[ *n ].field = field;
+		issues[ *n ].wlan = wlan;
+		issues[ *n ].kind = kind;
+		issues[ *n ].value = value;
+	}
+	(*n)++;
+}
+
+static int sanity_outside( unsigned char v, const mib_bound_t *b )
+{
+	return v < b->min || v > b->max;
+}
+
+unsigned int mib_sanity( const mib_t *mib, const mib_limits_t *lim,
+			 mib_issue_t *issues, unsigned int max )
+{
+	const unsigned char *base = (const unsigned char *)mib;
+	const sanity_field_t *s;
+	const mib_field_t *f;
+	const unsigned char *p;
+	unsigned int wlan, wlan_num, i, n = 0, first_pwr = 0;
+	int used[2], uniform, over, kind;
+
+	pthread_once( &sanity_once, sanity_init );
+
+	wlan_num = mib->wlan_num ? mib->wlan_num : 1;
+	if ( wlan_num > NUM_WLAN_INTERFACE )
+		wlan_num = NUM_WLAN_INTERFACE;
+
+	for ( wlan = 0; wlan <= wlan_num; wlan++ ) {
+		/* round 0 covers the board fields, then one per interface */
+		used[0] = used[1] = 0;
+		for ( i = 0; wlan && i < sanity_num; i++ ) {
+			s = &sanity_fields[i];
+			f = &mib_fields[ s->field ];
+			if ( s->check != SANITY_PWR ||
+			     !mib_field_present( mib, s->field, wlan - 1 ) )
+				continue;
+			if ( !first_pwr )
+				first_pwr = s->field;
+			p = base + f->offset + (wlan - 1) * sizeof(mib_wlan_t);
+			sanity_scan( p, f->size, 0xff, &uniform );
+			if ( !uniform || (p[0] != 0 && p[0] != 0xff) )
+				used[ s->band ] = 1;
+		}
+		if ( wlan && !used[0] && !used[1] )
+			sanity_add( issues, max, &n, first_pwr, wlan - 1,
+				    MIB_ISSUE_NOCAL, 0 );
+
+		for ( i = 0; i < sanity_num; i++ ) {
+			s = &sanity_fields[i];
+			f = &mib_fields[ s->field ];
+			if ( !f->wlan != !wlan ||
+			     !mib_field_present( mib, s->field,
+						 wlan ? wlan - 1 : 0 ) )
+				continue;
+			p = base + f->offset;
+			if ( wlan )
+				p += (wlan - 1) * sizeof(mib_wlan_t);
+
+			kind = -1;
+			over = 0;
+			switch ( s->check ) {
+			case SANITY_PWR:
+			case SANITY_DIFF:
+				if ( !used[ s->band ] )
+					break;
+				over = sanity_scan( p, f->size,
+					s->check == SANITY_PWR ?
+						lim->pwr_max : 0xff,
+					&uniform );
+				if ( uniform && p[0] == 0xff )
+					kind = MIB_ISSUE_BLANK;
+				else if ( uniform && !p[0] &&
+					  (s->check == SANITY_PWR ||
+					   lim->diff_zero) )
+					kind = MIB_ISSUE_ZERO;
+				else if ( over >= 0 )
+					kind = MIB_ISSUE_RANGE;
+				break;
+			case SANITY_MAC:
+			case SANITY_MAC_OPT:
+				sanity_scan( p, 6, 0xff, &uniform );
+				if ( uniform && p[0] == 0xff )
+					kind = MIB_ISSUE_MAC_BCAST;
+				else if ( uniform && !p[0] )
+					kind = s->check == SANITY_MAC ?
+						MIB_ISSUE_MAC_ZERO : -1;
+				else if ( p[0] & 1 )
+					kind = MIB_ISSUE_MAC_MCAST;
+				break;
+			case SANITY_THER:
+			case SANITY_XCAP:
+			case SANITY_TSSI:
+				over = *p;
+				if ( sanity_outside( *p,
+					s->check == SANITY_THER ? &lim->ther :
+					s->check == SANITY_XCAP ? &lim->xcap :
+								  &lim->tssi ) )
+					kind = MIB_ISSUE_RANGE;
+				break;
+			}
+			if ( kind >= 0 )
+				sanity_add( issues, max, &n, s->field,
+					    wlan ? wlan - 1 : 0, kind, over );
+		}
+	}
+
+	return n;
+}
+
+void mib_limits_default( mib_limits_t *lim )
+{
+	lim->ther.min = 0x01;
+	lim->ther.max = 0x3f;
+	lim->xcap.min = 0x00;
+	lim->xcap.max = 0x3f;
+	lim->tssi.min = 0x00;
+	lim->tssi.max = 0xfe;
+	lim->pwr_max = 0x3f;
+	lim->diff_zero = 0;
+}
+
+static int limits_byte( const char *s, char **end, unsigned char *v )
+{
+	unsigned long n = strtoul( s, end, 0 );
+
+	if ( *end == s || n > 0xff )
+		return -1;
+	*v = n;
+	return 0;
+}
+
+int mib_limits_parse( mib_limits_t *lim, const char *spec )
+{
+	static const struct {
+		const char *key;
+		size_t off;
+	} bounds[] = {
+		{ "ther", offsetof(mib_limits_t, ther) },
+		{ "xcap", offsetof(mib_limits_t, xcap) },
+		{ "tssi", offsetof(mib_limits_t, tssi) },
+	};
+	const char *p = spec;
+	mib_bound_t *b;
+	unsigned char v;
+	char *end;
+	size_t i, n;
+
+	while ( *p ) {
+		n = strcspn( p, "=" );
+		if ( !p[n] )
+			return -1;
+
+		for ( i = 0; i < sizeof(bounds) / sizeof(bounds[0]); i++ )
+			if ( strlen( bounds[i].key ) == n &&
+			     !strncmp( p, bounds[i].key, n ) )
+				break;
+
+		if ( i < sizeof(bounds) / sizeof(bounds[0]) ) {
+			b = (mib_bound_t *)((char *)lim + bounds[i].off);
+			if ( limits_byte( p + n + 1, &end, &b->min ) ||
+			     *end != '-' ||
+			     limits_byte( end + 1, &end, &b->max ) ||
+			     b->min > b->max )
+				return -1;
+		} else if ( n == 3 && !strncmp( p, "pwr", 3 ) ) {
+			if ( limits_byte( p + n + 1, &end, &lim->pwr_max ) )
+				return -1;
+		} else if ( n == 8 && !strncmp( p, "diffzero", 8 ) ) {
+			if ( limits_byte( p + n + 1, &end, &v ) || v > 1 )
+				return -1;
+			lim->diff_zero = v;
+		} else {
+			return -1;
+		}
+
+		if ( *end && *end != ',' )
+			return -1;
+		p = *end ? end + 1 : end;
+	}
+
+	return 0;
+}
+
+const char *mib_issue_str( unsigned int kind )
+{
+	switch ( kind ) {
+	case MIB_ISSUE_BLANK:
+		return "blank";
+	case MIB_ISSUE_ZERO:
+		return "zero";
+	case MIB_ISSUE_RANGE:
+		return "out of range";
+	case MIB_ISSUE_NOCAL:
+		return "no power calibration";
+	case MIB_ISSUE_MAC_ZERO:
+		return "zero address";
+	case MIB_ISSUE_MAC_BCAST:
+		return "broadcast address";
+	case MIB_ISSUE_MAC_MCAST:
+	default:
+		return "multicast address";
+	}
+}
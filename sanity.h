@@ -0,0 +1,67 @@
+#ifndef _SANITY_H_
+#define _SANITY_H_
+
+#include <stdint.h>
+
+/*
+ * Plausibility checks on a decoded MIB, cheap enough for every boot:
+ * calibration tables that are erased (all 0xff) or zeroed, power
+ * levels above what the chips take, thermal, crystal and TSSI values
+ * outside their bounds, and MAC addresses no interface should have.
+ *
+ * A band (2.4 or 5 GHz) of an interface only gets its tables checked
+ * if one of its power level tables holds something, single band radios
+ * leave the other band empty. Of the MAC addresses only nic0_addr and
+ * wlanN.macAddr have to be set, the others may stay zero.
+ * Include rtkmib.h first.
+ */
+enum {
+	MIB_ISSUE_BLANK,	/* every byte 0xff */
+	MIB_ISSUE_ZERO,		/* every byte 0 */
+	MIB_ISSUE_RANGE,	/* value, or a table byte, out of bounds */
+	MIB_ISSUE_NOCAL,	/* no power level table of either band */
+	MIB_ISSUE_MAC_ZERO,
+	MIB_ISSUE_MAC_BCAST,
+	MIB_ISSUE_MAC_MCAST,
+};
+
+typedef struct mib_issue {
+	unsigned short field;	/* index into mib_fields[] */
+	unsigned char wlan;
+	unsigned char kind;	/* MIB_ISSUE_* */
+	unsigned char value;	/* the offending byte for MIB_ISSUE_RANGE */
+} mib_issue_t;
+
+typedef struct mib_bound {
+	unsigned char min;
+	unsigned char max;
+} mib_bound_t;
+
+typedef struct mib_limits {
+	mib_bound_t ther;	/* Ther */
+	mib_bound_t xcap;	/* xCap */
+	mib_bound_t tssi;	/* TSSI1 and TSSI2 */
+	unsigned char pwr_max;	/* any power level table byte */
+	int diff_zero;		/* all zero pwrdiff tables count too */
+} mib_limits_t;
+
+/* Ther 1-0x3f, xCap 0-0x3f, TSSI 0-0xfe, power levels up to 0x3f */
+void mib_limits_default( mib_limits_t *lim );
+
+/*
+ * Change limits from a comma separated list of ther=MIN-MAX,
+ * xcap=MIN-MAX, tssi=MIN-MAX, pwr=MAX and diffzero=0|1.
+ * Returns 0 or -1 if spec does not parse.
+ */
+int mib_limits_parse( mib_limits_t *lim, const char *spec );
+
+/*
+ * Check *mib, storing up to max issues in field order. Returns how
+ * many were found, which may be more than max.
+ */
+unsigned int mib_sanity( const mib_t *mib, const mib_limits_t *lim,
+			 mib_issue_t *issues, unsigned int max );
+
+const char *mib_issue_str( unsigned int kind );
+
+#endif /* _SANITY_H_ */
@@ -0,0 +1,193 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "rtkmib.h"
+#include "lzss.h"
+#include "scan.h"
+
+#define SIG_ONES	0x0101010101010101ULL
+#define SIG_HIGHS	0x8080808080808080ULL
+
+static inline int sig_at( const unsigned char *p )
+{
+	return (p[0] == 'H' && p[1] == '6') || (p[0] == 'C' && p[1] == 'O');
+}
+
+/* non-zero if any byte of w equals c */
+static inline uint64_t sig_has_byte( uint64_t w, unsigned char c )
+{
+	w ^= SIG_ONES * c;
+	return (w - SIG_ONES) & ~w & SIG_HIGHS;
+}
+
+size_t mib_sig_search( const unsigned char *p, size_t len, size_t from )
+{
+	size_t i = from;
+	size_t end;
+	uint64_t w;
+
+	if ( len < 2 )
+		return len;
+
+#ifdef __SSE2__
+	const __m128i h = _mm_set1_epi8( 'H' );
+	const __m128i six = _mm_set1_epi8( '6' );
+	const __m128i c = _mm_set1_epi8( 'C' );
+	const __m128i o = _mm_set1_epi8( 'O' );
+
+	/* compare 16 byte pairs at once: p[i] against the first
+	 * signature byte and p[i + 1] against the second */
+	for ( ; i + 17 <= len; i += 16 ) {
+		__m128i a = _mm_loadu_si128( (const __m128i *)(p + i) );
+		__m128i b = _mm_loadu_si128( (const __m128i *)(p + i + 1) );
+		__m128i m = _mm_or_si128(
+			_mm_and_si128( _mm_cmpeq_epi8( a, h ),
+				       _mm_cmpeq_epi8( b, six ) ),
+			_mm_and_si128( _mm_cmpeq_epi8( a, c ),
+				       _mm_cmpeq_epi8( b, o ) ) );
+		int bits = _mm_movemask_epi8( m );
+
+		if ( bits )
+			return i + __builtin_ctz( bits );
+	}
+#endif
+
+	while ( i + 1 < len ) {
+		/* skip whole words without a first signature byte */
+		for ( ; i + 8 <= len; i += 8 ) {
+			memcpy( &w, p + i, sizeof(w) );
+			if ( sig_has_byte( w, 'H' ) | sig_has_byte( w, 'C' ) )
+				break;
+		}
+
+		end = i + 8 < len - 1 ? i + 8 : len - 1;
+		for ( ; i < end; i++ )
+			if ( sig_at( p + i ) )
+				return i;
+	}
+
+	return len;
+}
+
+static inline int is_digit( unsigned char c )
+{
+	return c >= '0' && c <= '9';
+}
+
+static int scan_check_comp( const unsigned char *p, size_t avail,
+			    mib_section_t *sect,
+			    unsigned char **dec, uint32_t *cap,
+			    lzss_realloc_t alloc, void *arg )
+{
+	const mib_hdr_compr_t *header = (const mib_hdr_compr_t *)p;
+	const char *type = (const char *)p + MIB_COMPR_TAG_LEN;
+	mib_hdr_t inner;
+	uint32_t clen, dlen, factor;
+
+	if ( avail < sizeof(mib_hdr_compr_t) ||
+	     memcmp( p, MIB_HEADER_COMP_TAG, MIB_COMPR_TAG_LEN ) )
+		return 0;
+
+	if ( memcmp( type, MIB_HEADER_COMPHS_TAG, 2 ) &&
+	     memcmp( type, MIB_HEADER_COMPDS_TAG, 2 ) &&
+	     memcmp( type, MIB_HEADER_COMPCS_TAG, 2 ) )
+		return 0;
+
+	clen = swap32( header->len );
+	factor = swap16( header->factor );
+	if ( !clen || !factor ||
+	     clen > avail - sizeof(mib_hdr_compr_t) )
+		return 0;
+
+	p += sizeof(mib_hdr_compr_t);
+	if ( lzss_decode( p, clen, (unsigned char *)&inner,
+			  sizeof(mib_hdr_t) ) != sizeof(mib_hdr_t) )
+		return 0;
+
+	/* vendor decoders allocate factor * len, anything bigger is junk */
+	dlen = sizeof(mib_hdr_t) + swap16( inner.len );
+	if ( (uint64_t)dlen > (uint64_t)factor * clen )
+		return 0;
+	if ( !memcmp( type, MIB_HEADER_COMPHS_TAG, 2 ) &&
+	     memcmp( inner.sig, MIB_HEADER_TAG, MIB_TAG_LEN ) )
+		return 0;
+
+	if ( mib_decode_into( (unsigned char *)p, clen, dec, cap,
+			      alloc, arg ) != (int)dlen )
+		return 0;
+
+	memcpy( sect->sig, header->sig, MIB_COMPR_SIG_LEN );
+	sect->sig[ MIB_COMPR_SIG_LEN ] = 0;
+	sect->compressed = 1;
+	sect->hdr_len = sizeof(mib_hdr_compr_t);
+	sect->len = clen;
+	sect->data_len = dlen;
+
+	return 1;
+}
+
+static int scan_check_plain( const unsigned char *p, size_t avail,
+			     mib_section_t *sect )
+{
+	const mib_hdr_t *header = (const mib_hdr_t *)p;
+	uint32_t len;
+
+	if ( avail < sizeof(mib_hdr_t) ||
+	     memcmp( p, MIB_HEADER_TAG, MIB_TAG_LEN ) )
+		return 0;
+
+	/* tag is followed by a two digit version */
+	if ( !is_digit( header->sig[2] ) || !is_digit( header->sig[3] ) )
+		return 0;
+
+	len = swap16( header->len );
+	if ( len < MIB_SIZE_MIN || len > avail - sizeof(mib_hdr_t) )
+		return 0;
+
+	memcpy( sect->sig, header->sig, MIB_SIG_LEN );
+	sect->sig[ MIB_SIG_LEN ] = 0;
+	sect->compressed = 0;
+	sect->hdr_len = sizeof(mib_hdr_t);
+	sect->len = len;
+	sect->data_len = sizeof(mib_hdr_t) + len;
+
+	return 1;
+}
+
+int mib_scan( const unsigned char *img, size_t size,
+	      mib_scan_cb cb, void *arg,
+	      lzss_realloc_t alloc, void *alloc_arg )
+{
+	unsigned char *dec = NULL;
+	uint32_t cap = 0;
+	mib_section_t sect;
+	size_t i = 0;
+	int found = 0;
+
+	if ( !img )
+		return 0;
+
+	while ( (i = mib_sig_search( img, size, i )) < size ) {
+		if ( scan_check_comp( img + i, size - i, &sect, &dec, &cap,
+				      alloc, alloc_arg ) ||
+		     scan_check_plain( img + i, size - i, &sect ) ) {
+			sect.offset = i;
+			found++;
+			if ( cb && cb( &sect, arg ) )
+				break;
+			/* sections do not overlap */
+			i += sect.hdr_len + sect.len;
+		} else {
+			i++;
+		}
+	}
+
+	if ( dec ) {
+		if ( alloc )
+			alloc( alloc_arg, dec, 0 );
+		else
+			free(dec);
+	}
+	return found;
+}
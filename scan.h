@@ -0,0 +1,36 @@
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lzss.h"
+
+typedef struct mib_section {
+	size_t offset;		/* of the header in the image */
+	char sig[ MIB_COMPR_SIG_LEN + 1 ];
+	int compressed;
+	uint32_t hdr_len;	/* on-flash header size */
+	uint32_t len;		/* on-flash payload size */
+	uint32_t data_len;	/* decoded section, mib_hdr_t included */
+} mib_section_t;
+
+/* return non-zero to stop the scan */
+typedef int (*mib_scan_cb)( const mib_section_t *sect, void *arg );
+
+/*
+ * Next position at or after from that starts with a "H6" or "CO"
+ * signature, or len if there is none.
+ */
+size_t mib_sig_search( const unsigned char *p, size_t len, size_t from );
+
+/*
+ * Sweep a whole flash image for MIB sections. Every candidate header
+ * is checked for a sane length and compressed ones are test decoded
+ * into a buffer from alloc. Returns the number of sections passed to cb.
+ */
+int mib_scan( const unsigned char *img, size_t size,
+	      mib_scan_cb cb, void *arg,
+	      lzss_realloc_t alloc, void *alloc_arg );
+
+#endif /* _SCAN_H_ */
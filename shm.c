@@ -0,0 +1,54 @@
+#include <sys/file.h>
+
+#include "rtkmib.h"
+#include "shm.h"
+
+int mib_shm_publish( const char *name, const mib_t *mib, int len,
+		     uint64_t fingerprint )
+{
+	mib_shm_t *shm;
+	uint32_t seq;
+	int fd;
+
+	fd = shm_open( name, O_RDWR | O_CREAT, 0644 );
+	if ( fd < 0 )
+		return -1;
+
+	/* one writer at a time, the lock goes with the fd if we die */
+	while ( flock( fd, LOCK_EX ) ) {
+		if ( errno != EINTR ) {
+			close( fd );
+			return -1;
+		}
+	}
+
+	if ( ftruncate( fd, sizeof(mib_shm_t) ) ) {
+		close( fd );
+		return -1;
+	}
+
+	shm = (mib_shm_t *)mmap( NULL, sizeof(mib_shm_t),
+				 PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	if ( shm == MAP_FAILED ) {
+		close( fd );
+		return -1;
+	}
+
+	/* odd sequence: readers spin or retry until the update is done */
+	seq = __atomic_load_n( &shm->seq, __ATOMIC_RELAXED ) | 1;
+	__atomic_store_n( &shm->seq, seq, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+
+	shm->magic = MIB_SHM_MAGIC;
+	shm->layout = sizeof(mib_t);
+	shm->wlan_size = sizeof(mib_wlan_t);
+	shm->len = len;
+	shm->fingerprint = fingerprint;
+	memcpy( &shm->mib, mib, sizeof(mib_t) );
+
+	__atomic_store_n( &shm->seq, seq + 1, __ATOMIC_RELEASE );
+
+	munmap( shm, sizeof(mib_shm_t) );
+	close( fd );
+	return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef _SHM_H_
+#define _SHM_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * The decoded mib_t published in POSIX shared memory. Readers map the
+ * segment read-only and use the seqlock below, no syscalls are needed
+ * after mib_shm_attach() unless an update is in progress. Publishers
+ * hold an flock() on the segment. Include rtkmib.h before this header;
+ * mib.wlan_num and mib.layout tell what the board carries.
+ *
+ *	const mib_shm_t *shm = mib_shm_attach( MIB_SHM_NAME );
+ *	uint32_t seq;
+ *	unsigned char mac[6];
+ *
+ *	do {
+ *		if ( mib_shm_read_begin( shm, &seq ) )
+ *			return -1;
+ *		memcpy( mac, shm->mib.wlan[0].macAddr, 6 );
+ *	} while ( mib_shm_read_retry( shm, seq ) );
+ */
+#define MIB_SHM_NAME		"/rtkmib"
+#define MIB_SHM_MAGIC		0x52544d42	/* "RTMB" */
+
+/*
+ * Polls of an odd sequence before a reader gives up, yielding after
+ * the first MIB_SHM_SPIN_BUSY so a publisher on the same CPU can
+ * finish. A publisher that died half way leaves the sequence odd
+ * until the next publish.
+ */
+#define MIB_SHM_SPIN		100000
+#define MIB_SHM_SPIN_BUSY	64
+
+typedef struct mib_shm {
+	uint32_t magic;
+	uint32_t layout;	/* sizeof(mib_t) */
+	uint32_t wlan_size;	/* sizeof(mib_wlan_t) */
+	uint32_t seq;		/* odd while an update is in progress */
+	int32_t len;		/* section length, see mib_load() */
+	uint32_t reserved;
+	uint64_t fingerprint;	/* of the on-flash section */
+	mib_t mib;
+} mib_shm_t;
+
+/* NULL if there is no segment or it was written for another layout */
+static inline const mib_shm_t *mib_shm_attach( const char *name )
+{
+	const mib_shm_t *shm;
+	struct stat st;
+	int fd;
+
+	fd = shm_open( name, O_RDONLY, 0 );
+	if ( fd < 0 )
+		return NULL;
+
+	if ( fstat( fd, &st ) || st.st_size != sizeof(mib_shm_t) ) {
+		close( fd );
+		return NULL;
+	}
+
+	shm = (const mib_shm_t *)mmap( NULL, sizeof(mib_shm_t), PROT_READ,
+				       MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( shm == MAP_FAILED )
+		return NULL;
+
+	if ( shm->magic != MIB_SHM_MAGIC || shm->layout != sizeof(mib_t) ||
+	     shm->wlan_size != sizeof(mib_wlan_t) ) {
+		munmap( (void *)shm, sizeof(mib_shm_t) );
+		return NULL;
+	}
+
+	return shm;
+}
+
+static inline void mib_shm_detach( const mib_shm_t *shm )
+{
+	munmap( (void *)shm, sizeof(mib_shm_t) );
+}
+
+/* 0 with *seq set, -1 with errno EBUSY if no update ever completes */
+static inline int mib_shm_read_begin( const mib_shm_t *shm, uint32_t *seq )
+{
+	unsigned int spin;
+
+	for ( spin = 0; spin < MIB_SHM_SPIN; spin++ ) {
+		*seq = __atomic_load_n( &shm->seq, __ATOMIC_ACQUIRE );
+		if ( !(*seq & 1) )
+			return 0;
+		if ( spin >= MIB_SHM_SPIN_BUSY )
+			sched_yield();
+	}
+
+	errno = EBUSY;
+	return -1;
+}
+
+/* non-zero if the segment changed while it was being read */
+static inline int mib_shm_read_retry( const mib_shm_t *shm, uint32_t seq )
+{
+	__atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+	return __atomic_load_n( &shm->seq, __ATOMIC_RELAXED ) != seq;
+}
+
+/* consistent copy of the whole mib_t, 0 or -1 as mib_shm_read_begin() */
+static inline int mib_shm_read( const mib_shm_t *shm, mib_t *mib )
+{
+	uint32_t seq;
+
+	do {
+		if ( mib_shm_read_begin( shm, &seq ) )
+			return -1;
+		memcpy( mib, &shm->mib, sizeof(mib_t) );
+	} while ( mib_shm_read_retry( shm, seq ) );
+
+	return 0;
+}
+
+/*
+ * Create or update the segment under an exclusive flock(), so
+ * concurrent publishers take turns. Returns 0 on success.
+ */
+int mib_shm_publish( const char *name, const mib_t *mib, int len,
+		     uint64_t fingerprint );
+
+#endif /* _SHM_H_ */
@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "rtkmib.h"
+#include "mibtbl.h"
+#include "lzss.h"
+#include "flash.h"
+#include "mib.h"
+#include "cache.h"
+#include "slot.h"
+
+uint32_t mib_slot_sum( const unsigned char *p, uint32_t len )
+{
+	uint64_t h = mib_fingerprint( MIB_FP_INIT, p, len );
+
+	return h ^ h >> 32;
+}
+
+/* header of the slot at, if its own checksum holds */
+static int mib_slot_header( flash_t *fl, unsigned int at, uint32_t size,
+			    mib_slot_hdr_t *hdr )
+{
+	unsigned char *p = flash_map( fl, at, sizeof(mib_slot_hdr_t) );
+	uint32_t len;
+
+	if ( !p )
+		return 0;
+	memcpy( hdr, p, sizeof(mib_slot_hdr_t) );
+
+	if ( memcmp( hdr->magic, MIB_SLOT_MAGIC, MIB_SLOT_MAGIC_LEN ) ||
+	     swap32(hdr->hsum) != mib_slot_sum( p,
+					offsetof(mib_slot_hdr_t, hsum) ) )
+		return 0;
+
+	len = swap32(hdr->len);
+	return len >= sizeof(mib_hdr_t) &&
+	       len <= size - sizeof(mib_slot_hdr_t);
+}
+
+static int mib_slot_intact( flash_t *fl, unsigned int at,
+			    const mib_slot_hdr_t *hdr )
+{
+	uint32_t len = swap32(hdr->len);
+	unsigned char *p = flash_map( fl, at + sizeof(mib_slot_hdr_t), len );
+
+	return p && mib_slot_sum( p, len ) == swap32(hdr->sum);
+}
+
+int mib_slot_select( flash_t *fl, unsigned int offset, uint32_t size,
+		     mib_slot_state_t *st )
+{
+	mib_slot_hdr_t hdr[2];
+	int valid[2], first, i, s;
+
+	st->active = -1;
+	st->seq = 0;
+	st->section = offset;
+
+	if ( size <= sizeof(mib_slot_hdr_t) )
+		return MIB_ERR_IO;
+
+	for ( i = 0; i < 2; i++ )
+		valid[i] = mib_slot_header( fl, offset + i * size, size,
+					    &hdr[i] );
+
+	/* newer first, sequence numbers compare across the wrap */
+	first = valid[1] && (!valid[0] ||
+		(int32_t)(swap32(hdr[1].seq) - swap32(hdr[0].seq)) > 0);
+
+	for ( i = 0; i < 2; i++ ) {
+		s = i ? !first : first;
+		if ( !valid[s] ||
+		     !mib_slot_intact( fl, offset + s * size, &hdr[s] ) )
+			continue;
+		st->active = s;
+		st->seq = swap32(hdr[s].seq);
+		st->section = offset + s * size + sizeof(mib_slot_hdr_t);
+		break;
+	}
+
+	return 0;
+}
+
+int mib_slot_set( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+		  uint32_t size, const mib_edit_t *edit, unsigned int n,
+		  unsigned int *blocks )
+{
+	mib_slot_state_t st;
+	mib_slot_hdr_t *hdr;
+	unsigned char *img = NULL, *buf = NULL;
+	uint32_t old_len, len, bs;
+	int err, target;
+
+	if ( blocks )
+		*blocks = 0;
+
+	/*
+	 * An erase for one slot must not take the other with it. Without
+	 * a known erase size assume the largest flash_update() uses.
+	 */
+	bs = fl->erasesize ? fl->erasesize : FLASH_ERASESIZE_DEFAULT;
+	if ( offset % bs || size % bs )
+		return MIB_ERR_LENGTH;
+
+	err = mib_slot_select( fl, offset, size, &st );
+	if ( err )
+		return err;
+
+	err = mib_patch( ctx, fl, st.section, edit, n, &img, &old_len );
+	if ( err < 0 )
+		return err;
+	len = err;
+
+	err = MIB_ERR_LENGTH;
+	if ( len > size - sizeof(mib_slot_hdr_t) )
+		goto out;
+
+	err = MIB_ERR_NOMEM;
+	buf = (unsigned char *)mib_alloc( ctx, sizeof(mib_slot_hdr_t) + len );
+	if ( !buf )
+		goto out;
+	hdr = (mib_slot_hdr_t *)buf;
+	memcpy( hdr->magic, MIB_SLOT_MAGIC, MIB_SLOT_MAGIC_LEN );
+	hdr->seq = swap32( st.active < 0 ? 1 : st.seq + 1 );
+	hdr->len = swap32( len );
+	hdr->sum = swap32( mib_slot_sum( img, len ) );
+	hdr->hsum = swap32( mib_slot_sum( buf,
+				offsetof(mib_slot_hdr_t, hsum) ) );
+	memcpy( buf + sizeof(mib_slot_hdr_t), img, len );
+
+	/* a plain section at offset is slot A, so it goes to B first */
+	target = st.active == 1 ? 0 : 1;
+	err = flash_update( fl, offset + target * size, buf,
+			    sizeof(mib_slot_hdr_t) + len, blocks );
+	if ( err < 0 ) {
+		err = MIB_ERR_IO;
+		goto out;
+	}
+
+	/* the commit counts once the reader would pick it */
+	if ( mib_slot_select( fl, offset, size, &st ) || st.active != target )
+		err = MIB_ERR_IO;
+
+out:
+	mib_free( ctx, buf );
+	mib_free( ctx, img );
+	return err;
+}
@@ -0,0 +1,57 @@
+#ifndef _SLOT_H_
+#define _SLOT_H_
+
+#include <stdint.h>
+
+/*
+ * Optional A/B layout: two slots of size bytes at offset and at
+ * offset + size, each a mib_slot_hdr_t followed by an ordinary section.
+ * A commit goes to the slot not in use, with the next sequence number,
+ * and the reader takes the newest slot whose header and section
+ * checksums hold. A commit cut short by a power loss therefore leaves
+ * the previous slot in charge.
+ *
+ * Without a valid slot the section at offset is read as it is, so an
+ * existing image turns into slot A and the first commit goes to B.
+ * Include rtkmib.h, mibtbl.h, lzss.h, flash.h and mib.h first.
+ */
+#define MIB_SLOT_MAGIC		"RMAB"
+#define MIB_SLOT_MAGIC_LEN	4
+
+/* all fields big endian, like the section headers */
+typedef struct mib_slot_hdr {
+	unsigned char magic[ MIB_SLOT_MAGIC_LEN ];
+	uint32_t seq;		/* counts up with every commit, wraps */
+	uint32_t len;		/* section bytes that follow */
+	uint32_t sum;		/* mib_slot_sum() of them */
+	uint32_t hsum;		/* mib_slot_sum() of the fields above */
+} __PACK__ mib_slot_hdr_t;
+
+typedef struct mib_slot_state {
+	int active;		/* 0 or 1, -1 for a plain section */
+	uint32_t seq;		/* of the active slot */
+	unsigned int section;	/* offset of its section */
+} mib_slot_state_t;
+
+uint32_t mib_slot_sum( const unsigned char *p, uint32_t len );
+
+/*
+ * Pick the slot to read. Only the two headers are looked at, plus the
+ * section checksum of the newer one (and of the older one only if that
+ * fails). Returns 0 or MIB_ERR_IO.
+ */
+int mib_slot_select( flash_t *fl, unsigned int offset, uint32_t size,
+		     mib_slot_state_t *st );
+
+/*
+ * mib_set() for the A/B layout: the active section is patched and
+ * committed to the other slot, see mib_patch(). offset and size must
+ * be erase block aligned, to FLASH_ERASESIZE_DEFAULT if the device does
+ * not say, so the slots never share a block. Returns the number of
+ * erase blocks written or MIB_ERR_*.
+ */
+int mib_slot_set( mib_ctx_t *ctx, flash_t *fl, unsigned int offset,
+		  uint32_t size, const mib_edit_t *edit, unsigned int n,
+		  unsigned int *blocks );
+
+#endif /* _SLOT_H_ */